@@ -0,0 +1,97 @@
+#include "BerkeliumThread.h"
+#include <iostream>
+#include <chrono>
+#include "berkelium/Berkelium.hpp"
+
+BerkeliumThread::BerkeliumThread(unsigned int interval):active(false),update_interval(interval),open_windows(0){
+}
+BerkeliumThread::~BerkeliumThread(void){
+    stop();
+}
+
+void BerkeliumThread::start(void){
+    if(active) return;
+    active = true;
+    thread = std::thread(&BerkeliumThread::run, this);
+}
+
+void BerkeliumThread::stop(void){
+    if(!active) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active = false;
+    }
+    posted.notify_one();
+    thread.join();
+}
+
+bool BerkeliumThread::running(void) const {
+    return active;
+}
+
+void BerkeliumThread::post(const std::function<void()>& command){
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // queue full means the browser thread is far behind, wait for it to drain
+        drained.wait(lock, [&](){ return commands.push(command); });
+    }
+    posted.notify_one();
+}
+
+void BerkeliumThread::sync(void){
+    if(!active) return;
+    bool done = false;
+    post([this,&done](){
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [&done](){ return done; });
+}
+
+void BerkeliumThread::windowOpened(void){
+    open_windows++;
+}
+void BerkeliumThread::windowClosed(void){
+    if(open_windows) open_windows--;
+}
+
+// without the library (NO_BERKELIUM, paint_replay) the thread only runs commands
+void BerkeliumThread::run(void){
+#ifndef NO_BERKELIUM
+    if(!Berkelium::init(Berkelium::FileString::empty())){
+        std::cout << "Failed to initialize Berkelium!" << std::endl;
+    }
+#endif
+    std::function<void()> command;
+    while(active){
+        bool ran = false;
+        while(commands.pop(command)){
+            command();
+            ran = true;
+        }
+        if(ran){
+            // take the lock so a waiting post or sync cannot miss the wakeup
+            { std::lock_guard<std::mutex> lock(mutex); }
+            drained.notify_all();
+        }
+#ifndef NO_BERKELIUM
+        if(open_windows) Berkelium::update();
+#endif
+
+        // pages need pumping while open, with none open there is nothing to do until a post
+        std::unique_lock<std::mutex> lock(mutex);
+        auto woken = [this](){ return !active || !commands.empty(); };
+        if(open_windows) posted.wait_for(lock, std::chrono::microseconds(update_interval), woken);
+        else posted.wait(lock, woken);
+    }
+    // finish what was queued before shutting down
+    while(commands.pop(command)) command();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    drained.notify_all();
+#ifndef NO_BERKELIUM
+    Berkelium::destroy();
+#endif
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "SpscQueue.h"
+
+// Runs Berkelium on its own thread. Berkelium may only be touched from the
+// thread that initialised it, so window creation, navigation and input are
+// posted here as commands from the GL thread and run before each update.
+class BerkeliumThread {
+    public:
+        BerkeliumThread(unsigned int update_interval_us = 2000);
+        ~BerkeliumThread(void);
+
+        void start(void);
+        void stop(void);
+        bool running(void) const;
+
+        // queue a command, only call this from the GL thread
+        void post(const std::function<void()>& command);
+        // blocks until every command posted so far has run
+        void sync(void);
+
+        // only call these from commands, the thread sleeps until a post while no windows are open
+        void windowOpened(void);
+        void windowClosed(void);
+
+    private:
+        void run(void);
+
+        std::thread thread;
+        std::atomic<bool> active;
+        unsigned int update_interval;
+        unsigned int open_windows;
+        SpscQueue<std::function<void()>, 1024> commands;
+        std::mutex mutex;
+        // wakes the browser thread on a post, and the GL thread when commands have run
+        std::condition_variable posted;
+        std::condition_variable drained;
+};
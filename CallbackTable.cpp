@@ -0,0 +1,63 @@
+#include "CallbackTable.h"
+#include <wchar.h>
+
+static bool sameName(const Berkelium::WideString& a, const Berkelium::WideString& b){
+    return a.length() == b.length() && wmemcmp(a.data(), b.data(), a.length()) == 0;
+}
+
+CallbackTable::CallbackTable(void):slots(16),count(0){
+    for(size_t i = 0; i < slots.size(); i++) slots[i].handler = NULL;
+}
+
+// FNV-1a over the UTF-16/32 code units
+uint32_t CallbackTable::hashName(const Berkelium::WideString& name){
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < name.length(); i++){
+        hash ^= (uint32_t)name.data()[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void CallbackTable::insert(std::vector<Slot>& table, uint32_t hash, CallbackHandler* handler){
+    size_t mask = table.size() - 1;
+    for(size_t i = hash & mask; ; i = (i + 1) & mask){
+        if(!table[i].handler || (table[i].hash == hash && sameName(table[i].handler->funcName, handler->funcName))){
+            if(!table[i].handler) count++;
+            table[i].hash = hash;
+            table[i].handler = handler;
+            return;
+        }
+    }
+}
+
+void CallbackTable::add(CallbackHandler* handler){
+    // keep the load under a half so probes stay short, registering is rare
+    if((count + 1)*2 > slots.size()){
+        std::vector<Slot> grown(slots.size()*2);
+        for(size_t i = 0; i < grown.size(); i++) grown[i].handler = NULL;
+        count = 0;
+        for(size_t i = 0; i < slots.size(); i++){
+            if(slots[i].handler) insert(grown, slots[i].hash, slots[i].handler);
+        }
+        slots.swap(grown);
+    }
+    insert(slots, hashName(handler->funcName), handler);
+}
+
+CallbackHandler* CallbackTable::find(const Berkelium::WideString& name) const {
+    uint32_t hash = hashName(name);
+    size_t mask = slots.size() - 1;
+    for(size_t i = hash & mask; slots[i].handler; i = (i + 1) & mask){
+        if(slots[i].hash == hash && sameName(slots[i].handler->funcName, name)) return slots[i].handler;
+    }
+    return NULL;
+}
+
+size_t CallbackTable::size(void) const {
+    return count;
+}
+void CallbackTable::clear(void){
+    for(size_t i = 0; i < slots.size(); i++) slots[i].handler = NULL;
+    count = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "berkelium/WeakString.hpp"
+#include "berkelium/ScriptVariant.hpp"
+
+// native function bound to a javascript name, the return value answers synchronous calls
+struct CallbackHandler {
+    Berkelium::WideString funcName;
+    Berkelium::Script::Variant (*func)(const Berkelium::Script::Variant* args, size_t numArgs);
+};
+
+// Open addressing table of callback handlers keyed by a hash of the function name,
+// so dispatching a javascript call neither walks every handler nor allocates.
+// Handlers and their names have to outlive the table.
+class CallbackTable {
+    public:
+        CallbackTable(void);
+
+        // replaces a handler registered under the same name
+        void add(CallbackHandler* handler);
+        // NULL when nothing is registered under name
+        CallbackHandler* find(const Berkelium::WideString& name) const;
+        size_t size(void) const;
+        void clear(void);
+
+    private:
+        struct Slot {
+            uint32_t hash;
+            CallbackHandler* handler;
+        };
+        static uint32_t hashName(const Berkelium::WideString& name);
+        void insert(std::vector<Slot>& table, uint32_t hash, CallbackHandler* handler);
+
+        std::vector<Slot> slots;
+        size_t count;
+};
@@ -0,0 +1,95 @@
+#include "DamageRegion.h"
+#include <algorithm>
+
+static long rectArea(const Berkelium::Rect& r){
+    return (long)r.width() * (long)r.height();
+}
+static Berkelium::Rect rectUnion(const Berkelium::Rect& a, const Berkelium::Rect& b){
+    Berkelium::Rect r;
+    r.mLeft = std::min(a.left(), b.left());
+    r.mTop = std::min(a.top(), b.top());
+    r.mWidth = std::max(a.right(), b.right()) - r.mLeft;
+    r.mHeight = std::max(a.bottom(), b.bottom()) - r.mTop;
+    return r;
+}
+static long overlapArea(const Berkelium::Rect& a, const Berkelium::Rect& b){
+    long w = std::min(a.right(), b.right()) - std::max(a.left(), b.left());
+    long h = std::min(a.bottom(), b.bottom()) - std::max(a.top(), b.top());
+    if(w <= 0 || h <= 0) return 0;
+    return w * h;
+}
+
+DamageRegion::DamageRegion(unsigned int cost, size_t max):call_cost(cost),max_rects(max),fill_gaps(false){
+    region.reserve(max_rects+1);
+}
+
+// pixels uploaded in excess when a and b are sent as one rect, minus the saved call;
+// never pays off when the excess pixels may hold anything
+long DamageRegion::mergeCost(const Berkelium::Rect& a, const Berkelium::Rect& b) const {
+    long wasted = rectArea(rectUnion(a,b)) - (rectArea(a) + rectArea(b) - overlapArea(a,b));
+    if(wasted > 0 && !fill_gaps) return 1;
+    return wasted - (long)call_cost;
+}
+
+void DamageRegion::add(const Berkelium::Rect& rect){
+    if(rect.width() <= 0 || rect.height() <= 0) return;
+    Berkelium::Rect r = rect;
+    // keep absorbing existing rects as long as merging pays off, a merge can make
+    // a previously rejected neighbour cheap so restart after each one
+    bool merged = true;
+    while(merged){
+        merged = false;
+        for(size_t i = 0; i < region.size(); i++){
+            if(overlapArea(r, region[i]) == rectArea(r)){
+                // already covered
+                return;
+            }
+            if(mergeCost(r, region[i]) <= 0){
+                r = rectUnion(r, region[i]);
+                region[i] = region.back();
+                region.pop_back();
+                merged = true;
+                break;
+            }
+        }
+    }
+    // too many rects, fold into the cheapest neighbour instead
+    if(fill_gaps && region.size() >= max_rects){
+        size_t best = 0;
+        long best_cost = mergeCost(r, region[0]);
+        for(size_t i = 1; i < region.size(); i++){
+            long cost = mergeCost(r, region[i]);
+            if(cost < best_cost){
+                best = i;
+                best_cost = cost;
+            }
+        }
+        Berkelium::Rect folded = rectUnion(r, region[best]);
+        region[best] = region.back();
+        region.pop_back();
+        add(folded);
+        return;
+    }
+    region.push_back(r);
+}
+
+void DamageRegion::clear(void){
+    region.clear();
+}
+bool DamageRegion::empty(void) const {
+    return region.empty();
+}
+const std::vector<Berkelium::Rect>& DamageRegion::rects(void) const {
+    return region;
+}
+size_t DamageRegion::area(void) const {
+    size_t total = 0;
+    for(size_t i = 0; i < region.size(); i++) total += rectArea(region[i]);
+    return total;
+}
+void DamageRegion::setCallCost(unsigned int pixels){
+    call_cost = pixels;
+}
+void DamageRegion::setFillGaps(bool fill){
+    fill_gaps = fill;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include "berkelium/Rect.hpp"
+
+// Collects dirty rectangles and keeps them merged into a small set of upload
+// rectangles. Two rects are merged into their bounding box when the extra
+// pixels that would be uploaded cost less than one extra upload call, but only
+// if the buffer the rects are uploaded from holds valid pixels in the gaps too;
+// otherwise only rects whose union is a rect themselves are merged.
+class DamageRegion {
+    public:
+        DamageRegion(unsigned int call_cost = 4096, size_t max_rects = 16);
+
+        void add(const Berkelium::Rect& rect);
+        void clear(void);
+        bool empty(void) const;
+        const std::vector<Berkelium::Rect>& rects(void) const;
+        size_t area(void) const;
+
+        // per call overhead expressed in pixels
+        void setCallCost(unsigned int pixels);
+        // merge across pixels no rect covers, only for a buffer that mirrors the whole
+        // page; off by default, then the rect count is not capped either
+        void setFillGaps(bool fill);
+
+    private:
+        long mergeCost(const Berkelium::Rect& a, const Berkelium::Rect& b) const;
+
+        std::vector<Berkelium::Rect> region;
+        unsigned int call_cost;
+        size_t max_rects;
+        bool fill_gaps;
+};
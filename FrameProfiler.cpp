@@ -0,0 +1,160 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+
+FrameProfiler::FrameProfiler(size_t history, bool gpu):
+    history_size(history),gpu_timers(gpu && GLEW_ARB_timer_query),frame_slot(0),frame_count(0){
+    phase("frame");
+}
+FrameProfiler::~FrameProfiler(void){
+    for(size_t i = 0; i < phases.size(); i++){
+        for(unsigned int f = 0; f < QUERY_FRAMES; f++){
+            if(!phases[i].queries[f].empty()) glDeleteQueries(phases[i].queries[f].size(), &phases[i].queries[f][0]);
+        }
+    }
+}
+
+int FrameProfiler::phase(const std::string& name){
+    for(size_t i = 0; i < phases.size(); i++){
+        if(phases[i].name == name) return i;
+    }
+    Phase added;
+    added.name = name;
+    added.frame_cpu = 0.0f;
+    added.ran = false;
+    for(unsigned int f = 0; f < QUERY_FRAMES; f++) added.used[f] = 0;
+    added.cpu.samples.resize(history_size);
+    added.cpu.next = added.cpu.count = 0;
+    added.gpu = added.cpu;
+    phases.push_back(added);
+    return phases.size() - 1;
+}
+
+void FrameProfiler::begin(int id){
+    Phase& p = phases[id];
+    if(gpu_timers){
+        // timestamps rather than GL_TIME_ELAPSED, elapsed queries can't nest
+        std::vector<GLuint>& queries = p.queries[frame_slot];
+        size_t& used = p.used[frame_slot];
+        if(used + 2 > queries.size()){
+            queries.resize(used + 2);
+            glGenQueries(2, &queries[used]);
+        }
+        glQueryCounter(queries[used], GL_TIMESTAMP);
+    }
+    p.started = std::chrono::steady_clock::now();
+}
+void FrameProfiler::end(int id){
+    Phase& p = phases[id];
+    p.frame_cpu += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - p.started).count()/1000.0f;
+    p.ran = true;
+    if(gpu_timers){
+        glQueryCounter(p.queries[frame_slot][p.used[frame_slot] + 1], GL_TIMESTAMP);
+        p.used[frame_slot] += 2;
+    }
+}
+
+void FrameProfiler::beginFrame(void){
+    begin(0);
+}
+void FrameProfiler::endFrame(void){
+    end(0);
+    for(size_t i = 0; i < phases.size(); i++){
+        if(!phases[i].ran) continue;
+        phases[i].cpu.add(phases[i].frame_cpu);
+        phases[i].frame_cpu = 0.0f;
+        phases[i].ran = false;
+    }
+    frame_count++;
+    if(!gpu_timers) return;
+
+    // the oldest slot has had QUERY_FRAMES-1 frames to finish, it is reused next
+    frame_slot = (frame_slot + 1) % QUERY_FRAMES;
+    for(size_t i = 0; i < phases.size(); i++){
+        Phase& p = phases[i];
+        size_t used = p.used[frame_slot];
+        if(!used) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(p.queries[frame_slot][used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available){
+            GLuint64 total = 0;
+            for(size_t q = 0; q < used; q += 2){
+                GLuint64 start, stop;
+                glGetQueryObjectui64v(p.queries[frame_slot][q], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(p.queries[frame_slot][q + 1], GL_QUERY_RESULT, &stop);
+                total += stop - start;
+            }
+            p.gpu.add(total/1000.0f);
+        }
+        // a result that is still not in is dropped rather than stalling the frame
+        p.used[frame_slot] = 0;
+    }
+}
+
+size_t FrameProfiler::phaseCount(void) const {
+    return phases.size();
+}
+const std::string& FrameProfiler::phaseName(int id) const {
+    return phases[id].name;
+}
+FrameProfiler::Percentiles FrameProfiler::cpu(int id) const {
+    return phases[id].cpu.percentiles();
+}
+FrameProfiler::Percentiles FrameProfiler::gpu(int id) const {
+    return phases[id].gpu.percentiles();
+}
+unsigned long FrameProfiler::frames(void) const {
+    return frame_count;
+}
+
+void FrameProfiler::dump(std::ostream& out, Format format) const {
+    if(format == FORMAT_CSV){
+        out << "phase,clock,samples,mean_us,p50_us,p95_us,p99_us,max_us" << std::endl;
+        for(size_t i = 0; i < phases.size(); i++){
+            for(int clock = 0; clock < (gpu_timers ? 2 : 1); clock++){
+                Percentiles p = clock ? gpu(i) : cpu(i);
+                out << phases[i].name << "," << (clock ? "gpu" : "cpu") << "," << p.samples << "," << p.mean << ","
+                    << p.p50 << "," << p.p95 << "," << p.p99 << "," << p.max << std::endl;
+            }
+        }
+        return;
+    }
+    out << "{\"frames\":" << frame_count << ",\"phases\":[";
+    for(size_t i = 0; i < phases.size(); i++){
+        out << (i ? "," : "") << "{\"name\":\"" << phases[i].name << "\"";
+        for(int clock = 0; clock < (gpu_timers ? 2 : 1); clock++){
+            Percentiles p = clock ? gpu(i) : cpu(i);
+            out << ",\"" << (clock ? "gpu" : "cpu") << "\":{\"samples\":" << p.samples << ",\"mean\":" << p.mean << ",\"p50\":" << p.p50
+                << ",\"p95\":" << p.p95 << ",\"p99\":" << p.p99 << ",\"max\":" << p.max << "}";
+        }
+        out << "}";
+    }
+    out << "]}" << std::endl;
+}
+
+void FrameProfiler::reset(void){
+    for(size_t i = 0; i < phases.size(); i++){
+        phases[i].cpu.next = phases[i].cpu.count = 0;
+        phases[i].gpu.next = phases[i].gpu.count = 0;
+    }
+    frame_count = 0;
+}
+
+void FrameProfiler::History::add(float sample){
+    samples[next] = sample;
+    next = (next + 1) % samples.size();
+    if(count < samples.size()) count++;
+}
+FrameProfiler::Percentiles FrameProfiler::History::percentiles(void) const {
+    Percentiles result = {count, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    if(!count) return result;
+    std::vector<float> sorted(samples.begin(), samples.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    float sum = 0.0f;
+    for(size_t i = 0; i < count; i++) sum += sorted[i];
+    result.mean = sum/count;
+    result.p50 = sorted[(count - 1)*50/100];
+    result.p95 = sorted[(count - 1)*95/100];
+    result.p99 = sorted[(count - 1)*99/100];
+    result.max = sorted[count - 1];
+    return result;
+}
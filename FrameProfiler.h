@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <chrono>
+
+// Per phase frame timings. Every phase is timed on the CPU and, with timer queries,
+// on the GPU through timestamp pairs read back a few frames later. The last
+// history frames of each phase are kept for percentiles, which can be read back
+// in process or dumped as CSV or JSON. Only use it from the GL thread.
+class FrameProfiler {
+    public:
+        enum Format {
+            FORMAT_CSV,
+            FORMAT_JSON
+        };
+        // microseconds over the samples currently held
+        struct Percentiles {
+            size_t samples;
+            float mean, p50, p95, p99, max;
+        };
+
+        FrameProfiler(size_t history = 600, bool gpu_timers = true);
+        ~FrameProfiler(void);
+
+        // id of a named phase, registered on first use, phase 0 is the whole frame
+        int phase(const std::string& name);
+        // phases may nest, but a phase may not be nested in itself
+        void begin(int id);
+        void end(int id);
+        void beginFrame(void);
+        // records the phases run this frame and collects finished GPU timings
+        void endFrame(void);
+
+        size_t phaseCount(void) const;
+        const std::string& phaseName(int id) const;
+        Percentiles cpu(int id) const;
+        // all zero without GPU timers
+        Percentiles gpu(int id) const;
+        // frames recorded since the last reset()
+        unsigned long frames(void) const;
+        void dump(std::ostream& out, Format format) const;
+        void reset(void);
+
+    private:
+        // frames in flight before a timestamp query is read back
+        static const unsigned int QUERY_FRAMES = 4;
+
+        // fixed size window of samples
+        struct History {
+            std::vector<float> samples;
+            size_t next, count;
+            void add(float sample);
+            Percentiles percentiles(void) const;
+        };
+        struct Phase {
+            std::string name;
+            std::chrono::steady_clock::time_point started;
+            float frame_cpu;
+            bool ran;
+            // timestamp query pairs per frame in flight and how many of them were used
+            std::vector<GLuint> queries[QUERY_FRAMES];
+            size_t used[QUERY_FRAMES];
+            History cpu, gpu;
+        };
+
+        std::vector<Phase> phases;
+        size_t history_size;
+        bool gpu_timers;
+        unsigned int frame_slot;
+        unsigned long frame_count;
+};
+
+// times a phase for as long as it lives, a NULL profiler does nothing
+class ProfileScope {
+    public:
+        ProfileScope(FrameProfiler* profiler, int id):profiler(profiler),id(id){
+            if(profiler) profiler->begin(id);
+        }
+        ~ProfileScope(void){
+            if(profiler) profiler->end(id);
+        }
+
+    private:
+        FrameProfiler* profiler;
+        int id;
+};
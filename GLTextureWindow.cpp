@@ -1,75 +1,883 @@
 #include "GLTextureWindow.h"
 #include <iostream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
 #include <string.h>
 
-GLTextureWindow::GLTextureWindow(unsigned int w, unsigned int h, bool transp, bool verb):
-    width(w),height(h),needs_full_refresh(true),verbose(verb){
+GLTextureWindow::GLTextureWindow(unsigned int w, unsigned int h, bool transp, bool verb, BerkeliumThread* thread, bool headless):
+    bk_window(NULL),width(w),height(h),texture_target(GL_TEXTURE_2D),texture_layer(-1),array_pool(NULL),array_home(NULL),tiled_surface(NULL),shadow_surface(NULL),shadow_whole(false),needs_full_refresh(true),has_content(false),is_evicted(false),texture_bytes(0),verbose(verb),is_visible(true),staging_buffer(NULL),upload_mode(UPLOAD_DEFERRED),paint_version(0),upload_ring(NULL),upload_worker(NULL),
+    scroll_texture(0),scroll_checked(false),trace_writer(NULL),pixel_op(PIXEL_COPY),upload_format(GL_BGRA),bk_thread(thread),paint_packets(0),dropped_paints(0),drops_seen(0){
 
-    // generate a texture
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    GLfloat largest;
-    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &largest);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, largest);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // pick the cheapest way to move texels around the context supports
+    if(GLEW_ARB_copy_image) scroll_mode = SCROLL_COPY_IMAGE;
+    else if(GLEW_ARB_framebuffer_object) scroll_mode = SCROLL_BLIT;
+    else scroll_mode = SCROLL_READBACK;
+    scroll_fbos[0] = scroll_fbos[1] = 0;
 
-    // generate scroll buffer
-    scroll_buffer = new char[width*(height+1)*4];
+    createTexture();
+    resetStats();
 
     // create window
+    if(headless) return;
+    if(bk_thread) bk_thread->post(std::bind(&GLTextureWindow::createWindow, this, transp, w, h));
+    else createWindow(transp, w, h);
+}
+// paint_replay builds this file with NO_BERKELIUM and without the library, its windows
+// are all headless so nothing below that talks to a browser window ever runs there
+static void destroyWindow(Berkelium::Window* win){
+#ifndef NO_BERKELIUM
+    delete win;
+#endif
+}
+
+GLTextureWindow::~GLTextureWindow(void){
+    syncUploads();
+    if(staging_buffer) delete[] staging_buffer;
+    if(bk_thread){
+        // the window has to go on the thread that owns it, and no paint may still be in flight
+        Berkelium::Window* win = bk_window;
+        BerkeliumThread* thread = bk_thread;
+        bk_thread->post([win, thread](){
+            destroyWindow(win);
+            if(win) thread->windowClosed();
+        });
+        bk_thread->sync();
+        PaintPacket* packet;
+        while(ready_paints.pop(packet)) delete packet;
+        while(free_paints.pop(packet)) delete packet;
+    }else{
+        destroyWindow(bk_window);
+    }
+    delete shadow_surface;
+    if(tiled_surface) delete tiled_surface;
+    else if(array_pool) array_pool->release(texture_layer);
+    else glDeleteTextures(1, &texture_id); // will cause problems if texture is still being used
+    if(scroll_texture) glDeleteTextures(1, &scroll_texture);
+    if(scroll_fbos[0]) glDeleteFramebuffers(2, scroll_fbos);
+}
+
+// the size is passed along, width and height belong to the GL thread
+void GLTextureWindow::createWindow(bool transp, unsigned int w, unsigned int h){
+#ifndef NO_BERKELIUM
     Berkelium::Context *context = Berkelium::Context::create();
     bk_window = Berkelium::Window::create(context);
     delete context;
     bk_window->setDelegate(this);
-    bk_window->resize(width, height);
+    bk_window->resize(w, h);
     bk_window->setTransparent(transp);
+    if(bk_thread) bk_thread->windowOpened();
+#endif
 }
-GLTextureWindow::~GLTextureWindow(void){
-    delete scroll_buffer;
-    delete bk_window;
-    glDeleteTextures(1, &texture_id); // will cause problems if texture is still being used
+
+// a texture of the window's own, storage comes with the first full paint
+void GLTextureWindow::createTexture(void){
+    glGenTextures(1, &texture_id);
+    texture_bytes = 0;
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    GLfloat largest;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &largest);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, largest);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 }
 
 Berkelium::Window* GLTextureWindow::window(void) const {
     return bk_window;
 }
+
+void GLTextureWindow::withWindow(const std::function<void(Berkelium::Window*)>& command){
+    if(!bk_thread){
+        if(!bk_window) return;
+        command(bk_window);
+        return;
+    }
+    // bk_window is only assigned once the creation command has run, read it over there
+    bk_thread->post([this, command](){ command(bk_window); });
+}
+void GLTextureWindow::navigateTo(const std::string& url){
+    withWindow([url](Berkelium::Window* win){ win->navigateTo(url.data(), url.length()); });
+}
+void GLTextureWindow::focus(void){
+    withWindow([](Berkelium::Window* win){ win->focus(); });
+}
+void GLTextureWindow::mouseMoved(int x, int y){
+    withWindow([x, y](Berkelium::Window* win){ win->mouseMoved(x, y); });
+}
+void GLTextureWindow::mouseButton(unsigned int button, bool down){
+    withWindow([button, down](Berkelium::Window* win){ win->mouseButton(button, down); });
+}
+void GLTextureWindow::textEvent(const wchar_t* text, size_t length){
+    std::wstring str(text, length);
+    withWindow([str](Berkelium::Window* win){ win->textEvent(str.data(), str.length()); });
+}
+void GLTextureWindow::setTransparent(bool transp){
+    withWindow([transp](Berkelium::Window* win){ win->setTransparent(transp); });
+}
+void GLTextureWindow::recycle(void){
+    restore();
+    // nothing of the old page may show once the window is handed out again: its queued
+    // paints are dropped, the texture, shadow and damage blanked, and the window shows
+    // nothing until about:blank has painted in full
+    PaintPacket* packet;
+    while(ready_paints.pop(packet)) free_paints.push(packet);
+    clear();
+    if(shadow_surface) shadow_surface->clear();
+    shadow_whole = false;
+    damage.setFillGaps(false);
+    has_content = false;
+    navigateTo("about:blank");
+    // handlers are looked up on the berkelium thread, drop them over there
+    if(bk_thread){
+        bk_thread->post([this](){ handlers.clear(); });
+    }else{
+        handlers.clear();
+    }
+    pending_updates.clear();
+    update_slots.clear();
+    setTraceWriter(NULL);
+    verbose = false;
+    setVisible(true);
+    resetStats();
+}
+
+void GLTextureWindow::postUpdate(const std::string& key, const std::string& json){
+    std::map<std::string, size_t>::iterator slot = update_slots.find(key);
+    if(slot != update_slots.end()){
+        pending_updates[slot->second].second = json;
+        return;
+    }
+    update_slots[key] = pending_updates.size();
+    pending_updates.push_back(std::make_pair(key, json));
+}
+void GLTextureWindow::postUpdate(const std::string& key, double value){
+    // nan and inf are no javascript literals and would break the whole batch
+    if(!std::isfinite(value)){
+        postUpdate(key, std::string("null"));
+        return;
+    }
+    std::ostringstream json;
+    json.precision(17);
+    json << value;
+    postUpdate(key, json.str());
+}
+void GLTextureWindow::flushUpdates(void){
+    if(pending_updates.empty()) return;
+    // glexp.applyUpdates([["key",value],...]), dropped when the page has no dispatcher
+    // the script buffer is kept between frames, clearing it keeps its capacity
+    update_script.clear();
+    std::wstring& script = update_script;
+    script += L"window.glexp && glexp.applyUpdates([";
+    for(size_t i = 0; i < pending_updates.size(); i++){
+        script += i ? L",[\"" : L"[\"";
+        const std::string& key = pending_updates[i].first;
+        for(size_t c = 0; c < key.length(); c++){
+            if(key[c] == '"' || key[c] == '\\') script += L'\\';
+            script += (wchar_t)(unsigned char)key[c];
+        }
+        script += L"\",";
+        script.append(pending_updates[i].second.begin(), pending_updates[i].second.end());
+        script += L"]";
+    }
+    script += L"]);";
+    if(verbose) std::cout << "Flushing " << pending_updates.size() << " updates to the page" << std::endl;
+    pending_updates.clear();
+    update_slots.clear();
+    if(!bk_thread){
+        if(bk_window) bk_window->executeJavascript(Berkelium::WideString::point_to(script));
+        return;
+    }
+    // the berkelium thread runs it later, by then the buffer is being refilled
+    withWindow([script](Berkelium::Window* win){ win->executeJavascript(Berkelium::WideString::point_to(script)); });
+}
+
 GLuint GLTextureWindow::texture(void) const{
     return texture_id;
 }
+int GLTextureWindow::layer(void) const {
+    return texture_layer;
+}
+
+bool GLTextureWindow::setTextureArray(TextureArrayPool* pool){
+    if(tiled_surface) return false;
+    if(pool->width() != width || pool->height() != height) return false;
+    int allocated = pool->allocate();
+    if(allocated < 0) return false;
+    syncUploads();
+    if(array_pool) array_pool->release(texture_layer);
+    else glDeleteTextures(1, &texture_id);
+    array_pool = pool;
+    array_home = pool;
+    texture_id = pool->texture();
+    texture_target = GL_TEXTURE_2D_ARRAY;
+    texture_layer = allocated;
+    // a layer can't be read back on its own, blit instead
+    if(scroll_mode == SCROLL_READBACK) scroll_mode = SCROLL_BLIT;
+    clear();
+    if(shadow_surface && shadow_whole) refreshFromShadow();
+    return true;
+}
+
+void GLTextureWindow::setTiled(unsigned int tile_size, unsigned int max_tiles){
+    if(tiled_surface) return;
+    syncUploads();
+    if(array_pool) array_pool->release(texture_layer);
+    else glDeleteTextures(1, &texture_id);
+    array_pool = NULL;
+    array_home = NULL;
+    texture_layer = -1;
+    tiled_surface = new TiledSurface(width, height, tile_size, max_tiles, upload_format);
+    delete shadow_surface;
+    shadow_surface = NULL;
+    texture_id = tiled_surface->binding().atlas;
+    texture_target = GL_TEXTURE_2D_ARRAY;
+    // a page sized staging buffer is what tiling avoids, paints go to the tiles directly
+    if(staging_buffer){
+        delete[] staging_buffer;
+        staging_buffer = NULL;
+    }
+    clear();
+}
+TiledSurface* GLTextureWindow::tiledSurface(void) const {
+    return tiled_surface;
+}
+
+void GLTextureWindow::setShadowed(bool shadowed){
+    if(shadowed == (shadow_surface != NULL) || (shadowed && tiled_surface)) return;
+    // hidden windows stage their paints in whichever of the two holds the page, and the
+    // worker may read it until synced
+    uploadDamage();
+    syncUploads();
+    if(shadowed){
+        shadow_surface = new ShadowSurface(width, height);
+        if(staging_buffer){
+            delete[] staging_buffer;
+            staging_buffer = NULL;
+        }
+    }else{
+        delete shadow_surface;
+        shadow_surface = NULL;
+    }
+    shadow_whole = false;
+    damage.setFillGaps(false);
+}
+ShadowSurface* GLTextureWindow::shadowSurface(void) const {
+    return shadow_surface;
+}
+void GLTextureWindow::setVisibleRect(const Berkelium::Rect& rect){
+    if(tiled_surface) tiled_surface->setVisibleRect(rect);
+}
+
+void GLTextureWindow::resize(unsigned int w, unsigned int h){
+    if(w == width && h == height) return;
+    if(verbose) std::cout << "Resizing window from " << width << "x" << height << " to " << w << "x" << h << std::endl;
+    width = w;
+    height = h;
+    syncUploads();
+    // everything sized after the page starts over, paints still in flight for the
+    // old size are dropped while waiting for the full paint
+    if(staging_buffer){
+        delete[] staging_buffer;
+        staging_buffer = NULL;
+    }
+    if(scroll_texture){
+        glDeleteTextures(1, &scroll_texture);
+        scroll_texture = 0;
+    }
+    damage.clear();
+    needs_full_refresh = true;
+    if(shadow_surface) shadow_surface->resize(w, h);
+    shadow_whole = false;
+    damage.setFillGaps(false);
+    if(tiled_surface){
+        tiled_surface->resize(w, h);
+    }else if(array_pool && (array_pool->width() != w || array_pool->height() != h)){
+        // layers have the array's size, move to a texture of our own
+        array_pool->release(texture_layer);
+        array_pool = NULL;
+        texture_layer = -1;
+        texture_target = GL_TEXTURE_2D;
+        createTexture();
+    }else if(!array_pool && array_home && !is_evicted){
+        // back at the array's size, stays on its own texture when the array is full
+        setTextureArray(array_home);
+    }
+    withWindow([w, h](Berkelium::Window* win){ win->resize(w, h); });
+}
+unsigned int GLTextureWindow::pageWidth(void) const {
+    return width;
+}
+unsigned int GLTextureWindow::pageHeight(void) const {
+    return height;
+}
 
 void GLTextureWindow::clear(void){
-    unsigned char black = 0;
+    syncUploads();
+    if(tiled_surface){
+        tiled_surface->clear();
+    }else if(array_pool){
+        // layer storage is fixed, blank it instead
+        if(GLEW_ARB_clear_texture){
+            glClearTexSubImage(texture_id, 0, 0, 0, texture_layer, width, height, 1, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+        }else{
+            // zeros kept around so repeated clears do not allocate
+            if(clear_buffer.size() < width*height*4) clear_buffer.resize(width*height*4, 0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture_layer, width, height, 1, GL_BGRA, GL_UNSIGNED_BYTE, &clear_buffer[0]);
+        }
+    }else{
+        // one black texel in the page's format, the next full paint brings the storage back
+        unsigned char black[4] = {0, 0, 0, 255};
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_BGRA, GL_UNSIGNED_BYTE, black);
+        texture_bytes = 0;
+    }
+    needs_full_refresh = true;
+    damage.clear();
+}
+
+void GLTextureWindow::evict(void){
+    if(is_evicted || tiled_surface || array_pool) return;
+    if(verbose) std::cout << "Evicting " << memoryBytes() << " bytes" << std::endl;
+    syncUploads();
+    clear();
+    if(staging_buffer){
+        delete[] staging_buffer;
+        staging_buffer = NULL;
+    }
+    if(scroll_texture){
+        glDeleteTextures(1, &scroll_texture);
+        scroll_texture = 0;
+    }
+    is_evicted = true;
+}
+
+void GLTextureWindow::restore(void){
+    if(!is_evicted) return;
+    is_evicted = false;
+    // with the array full the own texture gets its storage with the full paint
+    if(array_home && array_home->width() == width && array_home->height() == height) setTextureArray(array_home);
+    if(shadow_surface && shadow_whole){
+        // the shadow kept up while evicted, no need to bother the browser
+        refreshFromShadow();
+        return;
+    }
+    needs_full_refresh = true;
+    requestFullPaint();
+}
+
+bool GLTextureWindow::evicted(void) const {
+    return is_evicted;
+}
+bool GLTextureWindow::hasContent(void) const {
+    return has_content && !is_evicted;
+}
+
+size_t GLTextureWindow::memoryBytes(void) const {
+    size_t bytes = 0;
+    if(tiled_surface) bytes += tiled_surface->residentBytes() + tiled_surface->parkedBytes();
+    else if(!array_pool) bytes += texture_bytes;
+    if(staging_buffer) bytes += width*(height+1)*4;
+    if(scroll_texture) bytes += width*height*4;
+    if(shadow_surface) bytes += shadow_surface->bytes();
+    return bytes;
+}
+
+// storage for the window's own texture, array layers and tiles have theirs
+void GLTextureWindow::allocateTexture(void){
+    if(array_pool || tiled_surface) return;
+    syncUploads();
     glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, 3, 1, 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, &black);
+    // sized like the scroll scratch texture, glCopyImageSubData wants the formats to match
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+    texture_bytes = width*height*4;
+}
+
+// the whole page goes up out of the shadow with the next flush
+void GLTextureWindow::refreshFromShadow(void){
+    allocateTexture();
+    Berkelium::Rect page;
+    page.mLeft = 0;
+    page.mTop = 0;
+    page.mWidth = width;
+    page.mHeight = height;
+    damage.clear();
+    damage.add(page);
+    needs_full_refresh = false;
+}
+
+// berkelium has no call to repaint a page, so the page invalidates its whole viewport:
+// a transparent overlay covering it is added and taken away on the next tick, which
+// makes the renderer paint everything under it again without the page seeing a resize
+void GLTextureWindow::requestFullPaint(void){
+    withWindow([](Berkelium::Window* win){
+        win->executeJavascript(Berkelium::WideString::point_to(L"(function(){"
+            L"var d=document.createElement('div');"
+            L"d.style.cssText='position:fixed;left:0;top:0;right:0;bottom:0;background:rgba(0,0,0,0);pointer-events:none;z-index:2147483647';"
+            L"(document.body||document.documentElement).appendChild(d);"
+            L"setTimeout(function(){d.parentNode.removeChild(d);},0);"
+            L"})()"));
+    });
+}
+
+void GLTextureWindow::flush(void){
+    // replay paints handed over by the berkelium thread
+    PaintPacket* packet;
+    while(ready_paints.pop(packet)){
+        if(packet->drops != drops_seen) paintsDropped(packet->drops);
+        paint(packet->pixels.empty() ? NULL : &packet->pixels[0], packet->bitmap_rect, packet->copy_rects.size(),
+            packet->copy_rects.empty() ? NULL : &packet->copy_rects[0], packet->dx, packet->dy, packet->scroll_rect, PIXEL_COPY);
+        free_paints.push(packet);
+    }
+    unsigned long drops = dropped_paints;
+    if(drops != drops_seen) paintsDropped(drops);
+    // hidden windows hold on to their damage until they show up again
+    if(is_visible) uploadDamage();
+    // tiles do their own holding back, they only need to know what is seen
+    if(tiled_surface) tiled_surface->update(is_visible);
+}
+
+// the berkelium thread dropped paints it had no packet for, the page and the shadow
+// miss them, so wait for a full paint and have the page make one
+void GLTextureWindow::paintsDropped(unsigned long drops){
+    if(verbose) std::cout << "Dropped " << drops - drops_seen << " paints, repainting" << std::endl;
+    drops_seen = drops;
     needs_full_refresh = true;
+    shadow_whole = false;
+    damage.setFillGaps(false);
+    requestFullPaint();
+}
+
+void GLTextureWindow::uploadDamage(void){
+    if(damage.empty()) return;
+    const std::vector<Berkelium::Rect>& rects = damage.rects();
+    if(verbose) std::cout << "Flushing " << rects.size() << " rects, " << damage.area() << " pixels" << std::endl;
+    // staging buffer and shadow are laid out like the page, upload sub rects straight out of them
+    const unsigned char* page = shadow_surface ? shadow_surface->pixels() : (const unsigned char*)staging_buffer;
+    uploadRects(page, width, 0, 0, rects);
+    damage.clear();
+}
+
+// uploads rects from a pixel buffer row_length pixels wide whose first pixel sits at
+// (origin_x,origin_y) in page coordinates, through the upload ring when there is one
+void GLTextureWindow::uploadRects(const unsigned char* pixels, int row_length, int origin_x, int origin_y, const std::vector<Berkelium::Rect>& rects){
+    const int bytesPerPixel = 4;
+    if(tiled_surface){
+        paint_stats.upload_calls += tiled_surface->upload(pixels, row_length, origin_x, origin_y, rects);
+        for(size_t i = 0; i < rects.size(); i++) paint_stats.bytes_uploaded += rects[i].width()*rects[i].height()*bytesPerPixel;
+        return;
+    }
+    size_t bytes = 0;
+    for(size_t i = 0; i < rects.size(); i++) bytes += rects[i].width()*rects[i].height()*bytesPerPixel;
+    if(upload_worker){
+        UploadJob* job = upload_worker->acquire();
+        job->texture = texture_id;
+        job->target = texture_target;
+        job->layer = array_pool ? texture_layer : -1;
+        job->format = upload_format;
+        job->rects = rects;
+        const unsigned char* page = shadow_surface ? shadow_surface->pixels() : (const unsigned char*)staging_buffer;
+        if(pixels == page && row_length == (int)width && origin_x == 0 && origin_y == 0){
+            // the page buffer is only written by paint(), which syncs the jobs first,
+            // so the worker reads it in place
+            job->source = page;
+            job->row_length = row_length;
+            upload_worker->submit(job);
+            worker_jobs.push_back(job);
+            paint_stats.upload_calls += rects.size();
+            paint_stats.bytes_uploaded += bytes;
+            return;
+        }
+        // a paint's bitmap is gone after it, packed like for the ring the worker keeps the copy
+        job->source = NULL;
+        job->pixels.resize(bytes);
+        size_t offset = 0;
+        for(size_t i = 0; i < rects.size(); i++){
+            int wid = rects[i].width();
+            int hig = rects[i].height();
+            const unsigned char* src = pixels + ((rects[i].top() - origin_y)*row_length + rects[i].left() - origin_x)*bytesPerPixel;
+            for(int jj = 0; jj < hig; jj++){
+                memcpy(&job->pixels[offset + jj*wid*bytesPerPixel], src + jj*row_length*bytesPerPixel, wid*bytesPerPixel);
+            }
+            offset += wid*hig*bytesPerPixel;
+        }
+        upload_worker->submit(job);
+        worker_jobs.push_back(job);
+        paint_stats.bytes_copied += bytes;
+        paint_stats.upload_calls += rects.size();
+        paint_stats.bytes_uploaded += bytes;
+        return;
+    }
+    glBindTexture(texture_target, texture_id);
+    if(!upload_ring){
+        for(size_t i = 0; i < rects.size(); i++){
+            uploadRect(pixels, row_length, rects[i].left() - origin_x, rects[i].top() - origin_y, rects[i]);
+        }
+        return;
+    }
+    // a rect too big for a slot goes up in bands of rows, so full paints of pages
+    // larger than the slots still go through the ring
+    size_t slot_size = upload_ring->slotSize();
+    ring_pieces.clear();
+    for(size_t i = 0; i < rects.size(); i++){
+        int band = slot_size/(rects[i].width()*bytesPerPixel);
+        if(band == 0){
+            // not even a row fits
+            uploadRect(pixels, row_length, rects[i].left() - origin_x, rects[i].top() - origin_y, rects[i]);
+            continue;
+        }
+        for(int top = rects[i].top(); top < rects[i].bottom(); top += band){
+            Berkelium::Rect piece = rects[i];
+            piece.mTop = top;
+            piece.mHeight = std::min(band, rects[i].bottom() - top);
+            ring_pieces.push_back(piece);
+        }
+    }
+    ring_offsets.resize(ring_pieces.size());
+    size_t first = 0;
+    while(first < ring_pieces.size()){
+        // as many pieces as fit the slot
+        size_t last = first;
+        size_t slot_bytes = 0;
+        while(last < ring_pieces.size()){
+            size_t piece_bytes = ring_pieces[last].width()*ring_pieces[last].height()*bytesPerPixel;
+            if(slot_bytes + piece_bytes > slot_size) break;
+            ring_offsets[last++] = slot_bytes;
+            slot_bytes += piece_bytes;
+        }
+        unsigned char* slot = upload_ring->begin(slot_bytes);
+        if(!slot){
+            for(size_t i = first; i < last; i++){
+                const Berkelium::Rect& piece = ring_pieces[i];
+                uploadRect(pixels, row_length, piece.left() - origin_x, piece.top() - origin_y, piece);
+            }
+            first = last;
+            continue;
+        }
+        // pack the pieces back to back into the slot, the driver reads them asynchronously
+        for(size_t i = first; i < last; i++){
+            const Berkelium::Rect& piece = ring_pieces[i];
+            int wid = piece.width();
+            int hig = piece.height();
+            const unsigned char* src = pixels + ((piece.top() - origin_y)*row_length + piece.left() - origin_x)*bytesPerPixel;
+            if(wid == row_length){
+                memcpy(slot + ring_offsets[i], src, wid*hig*bytesPerPixel);
+            }else{
+                for(int jj = 0; jj < hig; jj++){
+                    memcpy(slot + ring_offsets[i] + jj*wid*bytesPerPixel, src + jj*row_length*bytesPerPixel, wid*bytesPerPixel);
+                }
+            }
+        }
+        paint_stats.bytes_copied += slot_bytes;
+        const unsigned char* base = upload_ring->end();
+        for(size_t i = first; i < last; i++){
+            uploadRect(base + ring_offsets[i], ring_pieces[i].width(), 0, 0, ring_pieces[i]);
+        }
+        upload_ring->release();
+        first = last;
+    }
+}
+
+// uploads dst from a pixel buffer row_length pixels wide, starting at (skip_x,skip_y)
+void GLTextureWindow::uploadRect(const void* pixels, int row_length, int skip_x, int skip_y, const Berkelium::Rect& dst){
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, skip_x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, skip_y);
+    if(array_pool){
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, dst.left(), dst.top(), texture_layer, dst.width(), dst.height(), 1, upload_format, GL_UNSIGNED_BYTE, pixels);
+    }else{
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dst.left(), dst.top(), dst.width(), dst.height(), upload_format, GL_UNSIGNED_BYTE, pixels);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    paint_stats.upload_calls++;
+    paint_stats.bytes_uploaded += dst.width()*dst.height()*4;
+}
+
+char* GLTextureWindow::stagingBuffer(void){
+    // one extra row is used when scrolling through client memory
+    if(!staging_buffer) staging_buffer = new char[width*(height+1)*4];
+    return staging_buffer;
+}
+
+void GLTextureWindow::setUploadRing(PixelUploadRing* ring){
+    upload_ring = ring;
+}
+
+void GLTextureWindow::setUploadWorker(UploadWorker* worker){
+    syncUploads();
+    upload_worker = worker;
+}
+
+void GLTextureWindow::syncUploads(void){
+    for(size_t i = 0; i < worker_jobs.size(); i++) upload_worker->finish(worker_jobs[i]);
+    worker_jobs.clear();
+}
+
+void GLTextureWindow::setVisible(bool visible){
+    if(visible == is_visible) return;
+    is_visible = visible;
+    if(verbose) std::cout << "Window " << (visible ? "shown" : "hidden") << std::endl;
+    // berkelium has no frame rate control, let the page slow down its own timers
+    std::wstring script = std::wstring(L"document.dispatchEvent(new CustomEvent('panelvisibility', {detail: {visible: ") +
+        (visible ? L"true" : L"false") + L"}}));";
+    if(!bk_thread){
+        if(bk_window) bk_window->executeJavascript(Berkelium::WideString::point_to(script));
+        return;
+    }
+    // the berkelium thread runs it later, by then the buffer is being refilled
+    withWindow([script](Berkelium::Window* win){ win->executeJavascript(Berkelium::WideString::point_to(script)); });
+}
+bool GLTextureWindow::visible(void) const {
+    return is_visible;
+}
+
+// pixel_op and trace_writer are read by onPaint(), so with a berkelium thread they are
+// set over there
+void GLTextureWindow::setPixelOp(PixelOp op){
+    if(bk_thread) bk_thread->post([this, op](){ pixel_op = op; });
+    else pixel_op = op;
+    upload_format = op == PIXEL_SWIZZLE ? GL_RGBA : GL_BGRA;
+    if(tiled_surface) tiled_surface->setFormat(upload_format);
+}
+
+void GLTextureWindow::setTraceWriter(PaintTraceWriter* writer){
+    if(bk_thread) bk_thread->post([this, writer](){ trace_writer = writer; });
+    else trace_writer = writer;
+}
+
+void GLTextureWindow::setVerbose(bool verb){
+    verbose = verb;
+}
+
+void GLTextureWindow::setUploadMode(UploadMode mode){
+    if(mode == UPLOAD_IMMEDIATE) flush();
+    upload_mode = mode;
+}
+
+const PaintStats& GLTextureWindow::stats(void) const {
+    return paint_stats;
+}
+void GLTextureWindow::resetStats(void){
+    memset(&paint_stats, 0, sizeof(paint_stats));
+}
+unsigned long GLTextureWindow::paintVersion(void) const {
+    return paint_version;
+}
+bool GLTextureWindow::pendingPaints(void) const {
+    return !ready_paints.empty() || (is_visible && !damage.empty());
+}
+
+void GLTextureWindow::setScrollMode(ScrollMode mode){
+    scroll_mode = mode;
+    scroll_checked = false;
+}
+
+void GLTextureWindow::attachPage(GLenum framebuffer){
+    if(array_pool) glFramebufferTextureLayer(framebuffer, GL_COLOR_ATTACHMENT0, texture_id, 0, texture_layer);
+    else glFramebufferTexture2D(framebuffer, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_id, 0);
+}
+
+// moves the texels in src to dst, both rects have the same size
+void GLTextureWindow::scrollTexture(const Berkelium::Rect& src, const Berkelium::Rect& dst){
+    const int bytesPerPixel = 4;
+    // the texels have to be there before they are moved
+    syncUploads();
+    int wid = src.width();
+    int hig = src.height();
+
+    if(scroll_mode != SCROLL_READBACK && !scroll_texture){
+        // scratch texture the shared region is bounced through, source and destination overlap
+        glGenTextures(1, &scroll_texture);
+        glBindTexture(GL_TEXTURE_2D, scroll_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    if(scroll_mode == SCROLL_COPY_IMAGE){
+        // drivers differ in which formats they copy between, the first scroll checks
+        // for an error and the window blits from then on if there was one
+        if(!scroll_checked) while(glGetError() != GL_NO_ERROR);
+        int z = array_pool ? texture_layer : 0;
+        glCopyImageSubData(texture_id, texture_target, 0, src.left(), src.top(), z,
+            scroll_texture, GL_TEXTURE_2D, 0, 0, 0, 0, wid, hig, 1);
+        glCopyImageSubData(scroll_texture, GL_TEXTURE_2D, 0, 0, 0, 0,
+            texture_id, texture_target, 0, dst.left(), dst.top(), z, wid, hig, 1);
+        if(scroll_checked) return;
+        scroll_checked = true;
+        if(glGetError() == GL_NO_ERROR) return;
+        if(verbose) std::cerr << "glCopyImageSubData failed, scrolling with blits" << std::endl;
+        scroll_mode = SCROLL_BLIT;
+    }
+
+    if(scroll_mode == SCROLL_BLIT){
+        GLint prev_draw, prev_read;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read);
+        if(!scroll_fbos[0]) glGenFramebuffers(2, scroll_fbos);
+        // page texture to scratch
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scroll_fbos[0]);
+        attachPage(GL_READ_FRAMEBUFFER);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scroll_fbos[1]);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scroll_texture, 0);
+        glBlitFramebuffer(src.left(), src.top(), src.right(), src.bottom(), 0, 0, wid, hig, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        // and back at the destination
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scroll_texture, 0);
+        attachPage(GL_DRAW_FRAMEBUFFER);
+        glBlitFramebuffer(0, 0, wid, hig, dst.left(), dst.top(), dst.right(), dst.bottom(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read);
+        return;
+    }
+
+    // fallback, round trip through client memory
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    char* staging = stagingBuffer();
+    int inc = 1;
+    char *outputBuffer = staging;
+    // source data is offset by 1 line to prevent memcpy aliasing (can happen if dy == 0 and dx != 0)
+    char *inputBuffer = staging+(width*1*bytesPerPixel);
+    int jj = 0;
+    if(dst.top() > src.top()){
+        // shift the buffer around so that we start in the extra row at the end and copy in reverse so that we don't cobber source data
+        outputBuffer = staging+((src.top()+hig+1)*width-hig*wid)*bytesPerPixel;
+        inputBuffer = staging;
+        inc = -1;
+        jj = hig-1;
+    }
+    // copy data out of texture
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, inputBuffer);
+    // manually copy out the region to the beginning of the buffer
+    for(; jj < hig && jj >= 0; jj+=inc){
+        memcpy(outputBuffer+(jj*wid)*bytesPerPixel,
+            inputBuffer+((src.top()+jj)*width+src.left())*bytesPerPixel,
+            wid*bytesPerPixel);
+    }
+    // push it back into the texture in the right location
+    glTexSubImage2D(GL_TEXTURE_2D, 0, dst.left(), dst.top(), wid, hig, GL_BGRA, GL_UNSIGNED_BYTE, outputBuffer);
+    paint_stats.bytes_copied += (width*height + wid*hig)*bytesPerPixel;
 }
 
 void GLTextureWindow::onPaint(Berkelium::Window* win, const unsigned char* bitmap_in, const Berkelium::Rect &bitmap_rect,
     size_t num_copy_rects, const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect &scroll_rect){
-    
-    const int bytesPerPixel = 4;
 
     if(verbose){
-        std::cout << (void*)win << " bitmap rect: w=" << bitmap_rect.width() << ", h=" << bitmap_rect.height() << ", (" << bitmap_rect.top() << "," << bitmap_rect.left() << ") tex size " << width << "x" << height << std::endl;
+        std::cout << (void*)win << " bitmap rect: w=" << bitmap_rect.width() << ", h=" << bitmap_rect.height() << ", (" << bitmap_rect.top() << "," << bitmap_rect.left() << ")" << std::endl;
         //std::cout << "bmp: " << &bitmap_in << std::endl;
     }
+    if(trace_writer) trace_writer->record(bitmap_in, bitmap_rect, num_copy_rects, copy_rects, dx, dy, scroll_rect);
+
+    if(!bk_thread){
+        // converted as the rects are copied out of the bitmap
+        paint(bitmap_in, bitmap_rect, num_copy_rects, copy_rects, dx, dy, scroll_rect, pixel_op);
+        return;
+    }
+
+    // no GL on this thread, copy the paint out for the GL thread to pick up; only state
+    // set over here is read, the rest of the window belongs to the GL thread
+    PaintPacket* packet;
+    if(!free_paints.pop(packet)){
+        if(paint_packets >= 63){
+            // the GL thread is not keeping up, or waits for this one in BerkeliumThread::sync(),
+            // so nothing waits here: the paint is dropped and flush() has the page repaint
+            dropped_paints++;
+            return;
+        }
+        packet = new PaintPacket();
+        paint_packets++;
+    }
+    // the bitmap is gone after this call so it has to be copied, but only the copy rects
+    // which are all berkelium vouches for, converted on the way when there is a conversion to do
+    packet->pixels.resize(bitmap_rect.width()*bitmap_rect.height()*4);
+    packet->copy_rects.clear();
+    for(size_t i = 0; i < num_copy_rects; i++){
+        Berkelium::Rect rect = copy_rects[i].intersect(bitmap_rect);
+        if(rect.width() <= 0 || rect.height() <= 0) continue;
+        size_t offset = ((rect.top() - bitmap_rect.top())*bitmap_rect.width() + rect.left() - bitmap_rect.left())*4;
+        convertPixelRect(pixel_op, &packet->pixels[offset], bitmap_rect.width()*4, bitmap_in + offset, bitmap_rect.width()*4, rect.width(), rect.height());
+        packet->copy_rects.push_back(rect);
+    }
+    packet->bitmap_rect = bitmap_rect;
+    packet->dx = dx;
+    packet->dy = dy;
+    packet->scroll_rect = scroll_rect;
+    packet->drops = dropped_paints;
+    ready_paints.push(packet);
+}
+
+// a paint is full when one of its copy rects covers the page, a page sized bitmap
+// only has valid pixels inside the copy rects
+static bool coversPage(const Berkelium::Rect& bitmap_rect, size_t num_copy_rects, const Berkelium::Rect* copy_rects, unsigned int w, unsigned int h){
+    for(size_t i = 0; i < num_copy_rects; i++){
+        Berkelium::Rect rect = copy_rects[i].intersect(bitmap_rect);
+        if(rect.left() == 0 && rect.top() == 0 && (unsigned)rect.right() == w && (unsigned)rect.bottom() == h) return true;
+    }
+    return false;
+}
+
+void GLTextureWindow::paint(const unsigned char* bitmap_in, const Berkelium::Rect &bitmap_rect,
+    size_t num_copy_rects, const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect &scroll_rect, PixelOp op){
+
+    bool full_paint = coversPage(bitmap_rect, num_copy_rects, copy_rects, width, height);
+    // the worker may still be reading the page buffer written below
+    syncUploads();
+    // the shadow takes every paint, evicted or waiting for a full one
+    if(shadow_surface){
+        // a scroll that moves the texture itself moves whatever is in it, so damage still
+        // pending has to land first, out of the shadow as it was before this paint
+        bool scrolls_texture = (dx != 0 || dy != 0) && !tiled_surface && !is_evicted && !needs_full_refresh && is_visible && scroll_mode != SCROLL_READBACK;
+        if(scrolls_texture && !damage.empty()){
+            uploadDamage();
+            syncUploads();
+        }
+        shadow_surface->scroll(scroll_rect, dx, dy);
+        if(full_paint){
+            shadow_surface->write(bitmap_in, bitmap_rect, 1, &bitmap_rect, op);
+            shadow_whole = true;
+            // a page mirror, merged rects may take in the pixels between paints
+            damage.setFillGaps(true);
+        }else shadow_surface->write(bitmap_in, bitmap_rect, num_copy_rects, copy_rects, op);
+    }
+    // nothing to paint into, restore() asks for the whole page again
+    if(is_evicted) return;
+    paint_stats.paints++;
+    paint_version++;
 
-    glBindTexture(GL_TEXTURE_2D, texture_id);
     // if full refresh is needed, wait for a full update
     if(needs_full_refresh){
-        if(bitmap_rect.left() != 0 || bitmap_rect.top() != 0 || (unsigned)bitmap_rect.right() != width || (unsigned)bitmap_rect.bottom() != height){
+        if(shadow_surface && shadow_whole){
+            // the shadow is a whole page even if this paint is not
+            if(verbose) std::cout << "Refreshing from shadow" << std::endl;
+            refreshFromShadow();
+            if(is_visible) uploadDamage();
+            has_content = true;
             return;
         }
+        if(!full_paint) return;
         // full update received and needed, draw to texture
         if(verbose) std::cout << "Doing full paint" << std::endl;
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap_in);
+        // (re)allocate storage, the pixels follow like any other rect
+        allocateTexture();
+        damage.clear();
+        bool upload_now = is_visible || tiled_surface;
+        if(upload_now && op == PIXEL_COPY){
+            uploadRects(bitmap_in, width, 0, 0, std::vector<Berkelium::Rect>(1, bitmap_rect));
+        }else{
+            // a bitmap that still needs converting goes up out of the page buffer
+            stageRects(bitmap_in, bitmap_rect, 1, &bitmap_rect, op);
+            if(upload_now) uploadDamage();
+        }
         needs_full_refresh = false;
+        has_content = true;
         return;
     }
 
     // first, handle scrolling because we need to shift existing data
-    if(dx != 0 || dy != 0){
+    if(tiled_surface){
+        tiled_surface->scroll(scroll_rect, dx, dy);
+    }else if(dx != 0 || dy != 0){
         // scroll_rect contains the rect we need to move, so figure out where data is moved by translating it
         Berkelium::Rect scrolled_rect = scroll_rect.translate(-dx, -dy);
         // next figure out where they intersec to find scrolled region
@@ -79,56 +887,72 @@ void GLTextureWindow::onPaint(Berkelium::Window* win, const unsigned char* bitma
             // scroll is performed by moving shared_rect
             Berkelium::Rect shared_rect = scrolled_shared_rect.translate(dx, dy);
 
-            int wid = scrolled_shared_rect.width();
-            int hig = scrolled_shared_rect.height();
             if(verbose)
-                std::cout << "Scroll rect: w=" << wid << ", h=" << hig << ", (" << scrolled_shared_rect.left() << "," << scrolled_shared_rect.top() << ") by (" << dx << "," << dy << ")" << std::endl;
-            int inc = 1;
-            char *outputBuffer = scroll_buffer;
-            // source data is offset by 1 line to prevent memcpy aliasing (can happen if dy == 0 and dx != 0)
-            char *inputBuffer = scroll_buffer+(width*1*bytesPerPixel);
-            int jj = 0;
-            if(dy > 0){
-                // shift the buffer around so that we start in the extra row at the end and copy in reverse so that we don't cobber source data
-                outputBuffer = scroll_buffer+((scrolled_shared_rect.top()+hig+1)*width-hig*wid)*bytesPerPixel;
-                inputBuffer = scroll_buffer;
-                inc = -1;
-                jj = hig-1;
-            }
-            // copy data out of texture
-            glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, inputBuffer);
-            // manually copy out the region to the beginning of the buffer
-            for(; jj < hig && jj >= 0; jj+=inc){
-                memcpy(outputBuffer+(jj*wid)*bytesPerPixel,
-                    inputBuffer+((scrolled_shared_rect.top()+jj)*width+scrolled_shared_rect.left())*bytesPerPixel,
-                    wid*bytesPerPixel);
+                std::cout << "Scroll rect: w=" << scrolled_shared_rect.width() << ", h=" << scrolled_shared_rect.height() << ", (" << scrolled_shared_rect.left() << "," << scrolled_shared_rect.top() << ") by (" << dx << "," << dy << ")" << std::endl;
+            if(shadow_surface && (!is_visible || scroll_mode == SCROLL_READBACK)){
+                // the shadow has moved already, the moved pixels go up like damage
+                // instead of reading the texture back or touching a hidden one
+                damage.add(shared_rect);
+            }else{
+                // pending damage has to land in the texture before it gets shifted around,
+                // hidden or not; with a shadow that happened before it scrolled
+                uploadDamage();
+                scrollTexture(scrolled_shared_rect, shared_rect);
             }
-            // push it back into the texture in the right location
-            glTexSubImage2D(GL_TEXTURE_2D, 0, shared_rect.left(), shared_rect.top(), shared_rect.width(), shared_rect.height(), GL_BGRA, GL_UNSIGNED_BYTE, outputBuffer);
         }
     }
     
     if(verbose) std::cout << "Doing partial paint" << std::endl;
 
-    // painting rects
-    for(size_t i = 0; i < num_copy_rects; i++){
-        int wid = copy_rects[i].width();
-        int hig = copy_rects[i].height();
-        int top = copy_rects[i].top() - bitmap_rect.top();
-        int left = copy_rects[i].left() - bitmap_rect.left();
-        for(int jj = 0; jj < hig; jj++){
-            memcpy(scroll_buffer + jj*wid*bytesPerPixel,
-                bitmap_in + (left + (jj + top) * bitmap_rect.width()) * bytesPerPixel,
-                wid * bytesPerPixel
-            );
+    if((upload_mode == UPLOAD_IMMEDIATE && is_visible) || tiled_surface){
+        // anything staged while hidden goes first
+        uploadDamage();
+        if(op != PIXEL_COPY){
+            // converted into the page buffer on the way, then uploaded from there
+            stageRects(bitmap_in, bitmap_rect, num_copy_rects, copy_rects, op);
+            uploadDamage();
+        }else{
+            // send this paint's rects straight out of the bitmap one by one, berkelium only
+            // vouches for the pixels inside them so they are never merged
+            paint_rects.clear();
+            for(size_t i = 0; i < num_copy_rects; i++){
+                Berkelium::Rect rect = copy_rects[i].intersect(bitmap_rect);
+                if(rect.width() > 0 && rect.height() > 0) paint_rects.push_back(rect);
+            }
+            uploadRects(bitmap_in, bitmap_rect.width(), bitmap_rect.left(), bitmap_rect.top(), paint_rects);
         }
-        glTexSubImage2D(GL_TEXTURE_2D, 0, copy_rects[i].left(), copy_rects[i].top(), wid, hig, GL_BGRA, GL_UNSIGNED_BYTE, scroll_buffer);
+    }else{
+        // stage rects at their page position, upload happens in flush()
+        stageRects(bitmap_in, bitmap_rect, num_copy_rects, copy_rects, op);
     }
 
     needs_full_refresh = false;
+    has_content = true;
 }
 
 
+// copies rects out of the bitmap into the staging buffer at their page position,
+// converting them with op
+void GLTextureWindow::stageRects(const unsigned char* bitmap_in, const Berkelium::Rect& bitmap_rect, size_t num_rects, const Berkelium::Rect* rects, PixelOp op){
+    const int bytesPerPixel = 4;
+    if(shadow_surface){
+        // paint() put them in the shadow already
+        for(size_t i = 0; i < num_rects; i++) damage.add(rects[i]);
+        return;
+    }
+    char* staging = stagingBuffer();
+    for(size_t i = 0; i < num_rects; i++){
+        int wid = rects[i].width();
+        int hig = rects[i].height();
+        int top = rects[i].top() - bitmap_rect.top();
+        int left = rects[i].left() - bitmap_rect.left();
+        convertPixelRect(op, (unsigned char*)staging + (rects[i].top()*width + rects[i].left())*bytesPerPixel, width*bytesPerPixel,
+            bitmap_in + (left + top*bitmap_rect.width())*bytesPerPixel, bitmap_rect.width()*bytesPerPixel, wid, hig);
+        paint_stats.bytes_copied += wid*hig*bytesPerPixel;
+        damage.add(rects[i]);
+    }
+}
+
 void GLTextureWindow::onAddressBarChanged(Berkelium::Window* win, Berkelium::URLString newURL){
     if(verbose) std::cout << "BK: Address bar URL changed to " << newURL << std::endl;
 }
@@ -231,6 +1055,7 @@ void GLTextureWindow::onShowContextMenu(Berkelium::Window* win, const Berkelium:
 }
 
 void GLTextureWindow::onJavascriptCallback(Berkelium::Window* win, void* replyMsg, Berkelium::URLString url, Berkelium::WideString funcName, Berkelium::Script::Variant *args, size_t numArgs){
+#ifndef NO_BERKELIUM
     if(verbose){
         std::cout << "BK: Javascript callback at URL " << url << ", " << (replyMsg ? "synchronous" : "async") << std::endl;
         std::wcout << L"  Function name: " << funcName << std::endl;
@@ -244,21 +1069,25 @@ void GLTextureWindow::onJavascriptCallback(Berkelium::Window* win, void* replyMs
             }
             Berkelium::Script::toJSON_free(jsonString);
         }
-        if(replyMsg){
-            win->synchronousScriptReturn(replyMsg, numArgs ? args[0] : Berkelium::Script::Variant());
-        }
     }
-    for(std::vector<CallbackHandler*>::size_type e = 0; e < handlers.size(); e++){
-        std::wcout << std::wstring(funcName.data(),funcName.length()) << std::endl;
-        std::wcout << handlers[e]->funcName << std::endl;
-        if(std::wstring(funcName.data(),funcName.length()) == std::wstring(handlers[e]->funcName.data(),handlers[e]->funcName.length())){
-            handlers[e]->func();
-        }
+    CallbackHandler* handler = handlers.find(funcName);
+    if(!handler){
+        if(verbose) std::wcout << L"  No handler for " << funcName << std::endl;
+        // a synchronous caller blocks until it gets an answer
+        if(replyMsg) win->synchronousScriptReturn(replyMsg, Berkelium::Script::Variant());
+        return;
     }
+    Berkelium::Script::Variant result = handler->func(args, numArgs);
+    if(replyMsg) win->synchronousScriptReturn(replyMsg, result);
+#endif
 }
-
+// handlers are looked up on the berkelium thread, so they are added over there
 void GLTextureWindow::registerCallback(CallbackHandler* handler){
-    handlers.push_back(handler);
+    if(bk_thread){
+        bk_thread->post([this, handler](){ handlers.add(handler); });
+    }else{
+        handlers.add(handler);
+    }
 }
 
 void GLTextureWindow::onRunFileChooser(Berkelium::Window* win, int mode, Berkelium::WideString title, Berkelium::FileString defaultFile){
@@ -2,25 +2,161 @@
 
 #include <GL/glew.h>
 #include <vector>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <map>
 #include "berkelium/Window.hpp"
 #include "berkelium/WindowDelegate.hpp"
 #include "berkelium/Context.hpp"
 #include "berkelium/ScriptUtil.hpp"
+#include "DamageRegion.h"
+#include "PixelUploadRing.h"
+#include "BerkeliumThread.h"
+#include "TextureArrayPool.h"
+#include "PaintTrace.h"
+#include "CallbackTable.h"
+#include "PixelConvert.h"
+#include "TiledSurface.h"
+#include "ShadowSurface.h"
+#include "UploadWorker.h"
 
-struct CallbackHandler {
-    Berkelium::WideString funcName; 
-    void (*func)(void);
+// upload counters, reset with GLTextureWindow::resetStats()
+struct PaintStats {
+    unsigned long paints;
+    unsigned long upload_calls;
+    unsigned long bytes_uploaded;
+    unsigned long bytes_copied;
+};
+
+// a paint captured on the berkelium thread, replayed on the GL thread
+struct PaintPacket {
+    std::vector<unsigned char> pixels;
+    Berkelium::Rect bitmap_rect;
+    std::vector<Berkelium::Rect> copy_rects;
+    int dx, dy;
+    Berkelium::Rect scroll_rect;
+    // paints dropped on the berkelium thread before this one
+    unsigned long drops;
 };
 
 class GLTextureWindow : public Berkelium::WindowDelegate {
     public:
-        GLTextureWindow(unsigned int w, unsigned int h, bool transp, bool verb = false);
+        // when partial paints reach the texture, deferred by default
+        enum UploadMode {
+            UPLOAD_IMMEDIATE, // each copy rect uploaded straight from the berkelium bitmap
+            UPLOAD_DEFERRED   // staged and coalesced over the whole frame, uploaded by flush()
+        };
+        // how scrolled content is moved inside the texture
+        enum ScrollMode {
+            SCROLL_COPY_IMAGE, // glCopyImageSubData through a scratch texture
+            SCROLL_BLIT,       // framebuffer blit through a scratch texture
+            SCROLL_READBACK    // read the texture back and re-upload, no GPU copy support
+        };
+
+        // with a berkelium thread the browser window lives on that thread and paints
+        // are handed over to the GL thread, which picks them up in flush()
+        // a headless window has no browser behind it, paints are fed in through onPaint()
+        GLTextureWindow(unsigned int w, unsigned int h, bool transp, bool verb = false, BerkeliumThread* thread = NULL, bool headless = false);
         ~GLTextureWindow(void);
 
+        // only safe to use directly without a berkelium thread, see withWindow()
         Berkelium::Window* window(void) const;
+        // the window's own GL_TEXTURE_2D, or the array texture when backed by a pool layer
         GLuint texture(void) const;
+        // layer in the texture array, -1 when the window has its own texture
+        int layer(void) const;
+        // move the window into a layer of a same size texture array, false when the pool is full
+        bool setTextureArray(TextureArrayPool* pool);
+        // back the window with sparse tiles instead of one texture, for pages larger
+        // than the working set that is on screen; texture() becomes the tile atlas
+        // and the page has to be painted again
+        void setTiled(unsigned int tile_size = 256, unsigned int max_tiles = 64);
+        // NULL unless the window is tiled
+        TiledSurface* tiledSurface(void) const;
+        // keep a client memory copy of the page that every paint goes to: partial paints
+        // are no longer dropped while waiting for a full one, eviction and texture moves
+        // restore from it and scrolls of hidden windows never touch the texture; takes the
+        // place of the staging buffer, not for tiled windows, set it before painting starts
+        void setShadowed(bool shadowed);
+        // NULL unless the window is shadowed
+        ShadowSurface* shadowSurface(void) const;
+        // page area on screen, tiles outside it are not uploaded
+        void setVisibleRect(const Berkelium::Rect& rect);
+        // re-rasterise the page at another size, the texture shows the old page until the
+        // first full paint at the new size; windows leaving their texture array show nothing
+        // until then and go back into it when resized to its size again
+        void resize(unsigned int w, unsigned int h);
+        unsigned int pageWidth(void) const;
+        unsigned int pageHeight(void) const;
+
+        // browser calls, run directly or marshalled to the berkelium thread
+        void withWindow(const std::function<void(Berkelium::Window*)>& command);
+        void navigateTo(const std::string& url);
+        void focus(void);
+        void mouseMoved(int x, int y);
+        void mouseButton(unsigned int button, bool down);
+        void textEvent(const wchar_t* text, size_t length);
+        void setTransparent(bool transp);
+        // back to a blank page with no callbacks, updates or trace, for reusing the window;
+        // the old page's pixels are gone right away
+        void recycle(void);
+
+        // keyed values for the page, a later post to a key replaces the pending value,
+        // json has to be ASCII (escape anything else as \uXXXX)
+        void postUpdate(const std::string& key, const std::string& json);
+        void postUpdate(const std::string& key, double value);
+        // hands the pending updates to js/glexp.js in one script call, call once per
+        // frame before Berkelium::update()
+        void flushUpdates(void);
 
         void clear(void);
+        // gives up the texture storage, staging buffer and scroll scratch texture; the
+        // window shows nothing and drops its paints until restore(), see TextureBudget
+        // tiled windows keep their tiles, windows on an array layer are never evicted
+        // since giving the layer back frees nothing
+        void evict(void);
+        // takes the storage back and has the page paint itself in full
+        void restore(void);
+        bool evicted(void) const;
+        // whether the texture shows a page, false until the first paint lands and
+        // while evicted
+        bool hasContent(void) const;
+        // bytes of texture and buffer memory the window holds including the shadow
+        // surface, without an array layer which the pool accounts for
+        size_t memoryBytes(void) const;
+        // upload the damage accumulated since the last flush, call once per frame
+        void flush(void);
+        void setScrollMode(ScrollMode mode);
+        void setUploadMode(UploadMode mode);
+        // route uploads through a shared PBO ring, NULL uploads from client memory;
+        // uploads larger than a slot are spread over several
+        void setUploadRing(PixelUploadRing* ring);
+        // hand uploads to a worker thread with a shared context instead, the ring is
+        // not used then; tiled windows keep uploading themselves
+        void setUploadWorker(UploadWorker* worker);
+        // makes the GL thread wait for the uploads handed to the worker, call before
+        // the texture is sampled
+        void syncUploads(void);
+        // convert pixels as they are copied out of berkelium's bitmap, PIXEL_SWIZZLE
+        // uploads RGBA instead of BGRA, set it before the window starts painting; this
+        // and the trace writer reach the berkelium thread in order with other commands
+        void setPixelOp(PixelOp op);
+        // record every paint to a trace, set it before the window starts painting
+        void setTraceWriter(PaintTraceWriter* writer);
+        // log berkelium callbacks and paints to stdout
+        void setVerbose(bool verb);
+        // hidden windows keep staging paints but only upload them once visible again,
+        // the page is told through a "panelvisibility" event so it can throttle itself
+        void setVisible(bool visible);
+        bool visible(void) const;
+
+        const PaintStats& stats(void) const;
+        void resetStats(void);
+        // counts the paints that reached the window, changes whenever the page did
+        unsigned long paintVersion(void) const;
+        // paints handed over or staged that the next flush() would upload
+        bool pendingPaints(void) const;
 
         virtual void onPaint(Berkelium::Window* win, const unsigned char* bitmap_in, const Berkelium::Rect &bitmap_rect,
             size_t num_copy_rects, const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect &scroll_rect);
@@ -50,11 +186,82 @@ class GLTextureWindow : public Berkelium::WindowDelegate {
         virtual void onExternalHost(Berkelium::Window* win, Berkelium::WideString message, Berkelium::URLString origin, Berkelium::URLString target);
 
     private:
+        void createWindow(bool transp, unsigned int w, unsigned int h);
+        void createTexture(void);
+        // op is the conversion the bitmap still needs, done as its rects are copied
+        void paint(const unsigned char* bitmap_in, const Berkelium::Rect &bitmap_rect,
+            size_t num_copy_rects, const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect &scroll_rect, PixelOp op);
+        void attachPage(GLenum framebuffer);
+        void scrollTexture(const Berkelium::Rect& src, const Berkelium::Rect& dst);
+        void requestFullPaint(void);
+        void allocateTexture(void);
+        void refreshFromShadow(void);
+        void uploadRect(const void* pixels, int row_length, int skip_x, int skip_y, const Berkelium::Rect& dst);
+        void uploadRects(const unsigned char* pixels, int row_length, int origin_x, int origin_y, const std::vector<Berkelium::Rect>& rects);
+        void stageRects(const unsigned char* bitmap_in, const Berkelium::Rect& bitmap_rect, size_t num_rects, const Berkelium::Rect* rects, PixelOp op);
+        void uploadDamage(void);
+        void paintsDropped(unsigned long drops);
+        char* stagingBuffer(void);
+
         Berkelium::Window* bk_window;
         unsigned int width, height;
         GLuint texture_id;
+        GLenum texture_target;
+        int texture_layer;
+        TextureArrayPool* array_pool;
+        // array the window was put in, kept while it has another size
+        TextureArrayPool* array_home;
+        TiledSurface* tiled_surface;
+        ShadowSurface* shadow_surface;
+        // the shadow has had a full paint at the current size, until then it can't
+        // stand in for the browser
+        bool shadow_whole;
         bool needs_full_refresh;
-        bool verbose;
-        char* scroll_buffer;
-        std::vector<CallbackHandler*> handlers;
+        // a paint reached the texture since the window was created
+        bool has_content;
+        bool is_evicted;
+        // storage of the window's own texture, 0 until the first full paint
+        size_t texture_bytes;
+        // read by the callbacks on the berkelium thread
+        std::atomic<bool> verbose;
+        bool is_visible;
+        // page sized copy of pending damage, also scratch space for readback scrolling
+        // only allocated once one of those needs it; nothing outside the damage is
+        // valid, so its rects are never merged across gaps
+        char* staging_buffer;
+        DamageRegion damage;
+        // copy rects of an immediate paint, kept to reuse the allocation
+        std::vector<Berkelium::Rect> paint_rects;
+        UploadMode upload_mode;
+        PaintStats paint_stats;
+        unsigned long paint_version;
+        PixelUploadRing* upload_ring;
+        // rects cut to fit the ring's slots and where they sit in their slot
+        std::vector<Berkelium::Rect> ring_pieces;
+        std::vector<size_t> ring_offsets;
+        UploadWorker* upload_worker;
+        std::vector<UploadJob*> worker_jobs;
+        ScrollMode scroll_mode;
+        GLuint scroll_texture;
+        GLuint scroll_fbos[2];
+        // the first copy image scroll has been checked for a GL error
+        bool scroll_checked;
+        CallbackTable handlers;
+        PaintTraceWriter* trace_writer;
+        PixelOp pixel_op;
+        GLenum upload_format;
+        // zeros for blanking an array layer without ARB_clear_texture
+        std::vector<unsigned char> clear_buffer;
+        // outbound updates in the order their keys were first posted
+        std::vector<std::pair<std::string, std::string> > pending_updates;
+        std::map<std::string, size_t> update_slots;
+        std::wstring update_script;
+        // paint handoff from the berkelium thread
+        BerkeliumThread* bk_thread;
+        SpscQueue<PaintPacket*, 64> ready_paints;
+        SpscQueue<PaintPacket*, 64> free_paints;
+        std::atomic<int> paint_packets;
+        std::atomic<unsigned long> dropped_paints;
+        // dropped paints the GL thread has asked a repaint for
+        unsigned long drops_seen;
 };
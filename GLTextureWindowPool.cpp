@@ -0,0 +1,92 @@
+#include "GLTextureWindowPool.h"
+#include <iostream>
+
+GLTextureWindowPool::GLTextureWindowPool(BerkeliumThread* thread, PixelUploadRing* ring, TextureArrayPool* pool, bool verb):
+    bk_thread(thread),upload_ring(ring),upload_worker(NULL),array_pool(pool),verbose(verb){
+}
+GLTextureWindowPool::~GLTextureWindowPool(void){
+    // handed out windows belong to whoever acquired them
+    for(std::map<Resolution, std::vector<GLTextureWindow*> >::iterator it = idle_windows.begin(); it != idle_windows.end(); ++it){
+        for(size_t i = 0; i < it->second.size(); i++) delete it->second[i];
+    }
+}
+
+GLTextureWindow* GLTextureWindowPool::create(const Resolution& res){
+    if(verbose) std::cout << "Creating pooled " << res.first << "x" << res.second << " window" << std::endl;
+    GLTextureWindow* window = new GLTextureWindow(res.first, res.second, false, false, bk_thread);
+    window->setUploadRing(upload_ring);
+    window->setUploadWorker(upload_worker);
+    if(array_pool && array_pool->width() == res.first && array_pool->height() == res.second){
+        window->setTextureArray(array_pool);
+    }
+    // the blank page's full paint allocates the texture before the window is needed
+    window->navigateTo("about:blank");
+    return window;
+}
+
+void GLTextureWindowPool::reserve(unsigned int w, unsigned int h, size_t count){
+    reserved[Resolution(w, h)] = count;
+}
+
+void GLTextureWindowPool::setUploadWorker(UploadWorker* worker){
+    upload_worker = worker;
+}
+
+void GLTextureWindowPool::maintain(void){
+    // idle windows still get paints, their queues must not fill up
+    for(std::map<Resolution, std::vector<GLTextureWindow*> >::iterator it = idle_windows.begin(); it != idle_windows.end(); ++it){
+        for(size_t i = 0; i < it->second.size(); i++){
+            // last frame's uploads had a frame to be issued, nothing samples idle windows
+            it->second[i]->syncUploads();
+            it->second[i]->flush();
+        }
+    }
+    for(std::map<Resolution, size_t>::iterator it = reserved.begin(); it != reserved.end(); ++it){
+        std::vector<GLTextureWindow*>& windows = idle_windows[it->first];
+        if(windows.size() < it->second){
+            windows.push_back(create(it->first));
+            return;
+        }
+    }
+}
+
+GLTextureWindow* GLTextureWindowPool::acquire(unsigned int w, unsigned int h, bool transp){
+    Resolution res(w, h);
+    std::vector<GLTextureWindow*>& windows = idle_windows[res];
+    GLTextureWindow* window;
+    if(windows.empty()){
+        window = create(res);
+    }else{
+        window = windows.back();
+        windows.pop_back();
+    }
+    window->setTransparent(transp);
+    active[window] = res;
+    return window;
+}
+
+void GLTextureWindowPool::release(GLTextureWindow* window){
+    std::map<GLTextureWindow*, Resolution>::iterator it = active.find(window);
+    if(it == active.end()) return;
+    window->resize(it->second.first, it->second.second);
+    window->recycle();
+    idle_windows[it->second].push_back(window);
+    active.erase(it);
+}
+
+size_t GLTextureWindowPool::idle(unsigned int w, unsigned int h) const {
+    std::map<Resolution, std::vector<GLTextureWindow*> >::const_iterator it = idle_windows.find(Resolution(w, h));
+    return it == idle_windows.end() ? 0 : it->second.size();
+}
+
+bool GLTextureWindowPool::needsMaintenance(void) const {
+    for(std::map<Resolution, size_t>::const_iterator it = reserved.begin(); it != reserved.end(); ++it){
+        if(idle(it->first.first, it->first.second) < it->second) return true;
+    }
+    for(std::map<Resolution, std::vector<GLTextureWindow*> >::const_iterator it = idle_windows.begin(); it != idle_windows.end(); ++it){
+        for(size_t i = 0; i < it->second.size(); i++){
+            if(it->second[i]->pendingPaints()) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <utility>
+#include "GLTextureWindow.h"
+
+// Keeps windows created ahead of time per resolution, with their texture storage
+// allocated and a blank page painted, so opening a panel takes a frame instead of
+// creating a browser window. Closed windows are recycled rather than destroyed.
+class GLTextureWindowPool {
+    public:
+        // windows of the array pool's resolution are put in one of its layers
+        GLTextureWindowPool(BerkeliumThread* thread = NULL, PixelUploadRing* ring = NULL, TextureArrayPool* array_pool = NULL, bool verbose = false);
+        ~GLTextureWindowPool(void);
+
+        // keep count idle windows of this resolution around, see maintain()
+        void reserve(unsigned int w, unsigned int h, size_t count);
+        // windows created from now on upload through the worker
+        void setUploadWorker(UploadWorker* worker);
+        // call once per frame: uploads what idle windows painted and creates at most
+        // one missing idle window, to spread the cost
+        void maintain(void);
+        // an idle window on about:blank, or a new one when none is left
+        GLTextureWindow* acquire(unsigned int w, unsigned int h, bool transp = false);
+        // takes a window back, blanks it and keeps it for the next acquire()
+        void release(GLTextureWindow* window);
+
+        size_t idle(unsigned int w, unsigned int h) const;
+        // whether maintain() has work: idle windows with paints waiting or windows to create
+        bool needsMaintenance(void) const;
+
+    private:
+        typedef std::pair<unsigned int, unsigned int> Resolution;
+
+        GLTextureWindow* create(const Resolution& res);
+
+        BerkeliumThread* bk_thread;
+        PixelUploadRing* upload_ring;
+        UploadWorker* upload_worker;
+        TextureArrayPool* array_pool;
+        bool verbose;
+        std::map<Resolution, std::vector<GLTextureWindow*> > idle_windows;
+        std::map<Resolution, size_t> reserved;
+        // resolution of every window handed out
+        std::map<GLTextureWindow*, Resolution> active;
+};
@@ -0,0 +1,81 @@
+#include "HeadlessContext.h"
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <iostream>
+
+struct HeadlessContext::Handles {
+    EGLDisplay display;
+    EGLConfig config;
+    EGLContext context;
+    // shares the textures with context
+    EGLContext worker_context;
+};
+
+HeadlessContext::HeadlessContext(void):handles(new Handles()){
+    handles->display = EGL_NO_DISPLAY;
+    handles->config = EGL_NO_CONFIG_KHR;
+    handles->context = EGL_NO_CONTEXT;
+    handles->worker_context = EGL_NO_CONTEXT;
+}
+HeadlessContext::~HeadlessContext(void){
+    if(handles->display != EGL_NO_DISPLAY){
+        eglMakeCurrent(handles->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(handles->worker_context != EGL_NO_CONTEXT) eglDestroyContext(handles->display, handles->worker_context);
+        if(handles->context != EGL_NO_CONTEXT) eglDestroyContext(handles->display, handles->context);
+        eglTerminate(handles->display);
+    }
+    delete handles;
+}
+
+// surfaceless platform first (llvmpipe in CI) then the default display
+bool HeadlessContext::create(bool shared_worker){
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay) handles->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if(handles->display == EGL_NO_DISPLAY) handles->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if(handles->display == EGL_NO_DISPLAY || !eglInitialize(handles->display, &major, &minor)){
+        std::cerr << "EGL initialisation failed" << std::endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLint configs = 0;
+    // nothing is ever drawn to a surface, any config or none at all will do
+    if(!eglChooseConfig(handles->display, config_attribs, &handles->config, 1, &configs) || configs == 0) handles->config = EGL_NO_CONFIG_KHR;
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    handles->context = eglCreateContext(handles->display, handles->config, EGL_NO_CONTEXT, context_attribs);
+    if(shared_worker) handles->worker_context = eglCreateContext(handles->display, handles->config, handles->context, context_attribs);
+    if(handles->context == EGL_NO_CONTEXT || !eglMakeCurrent(handles->display, EGL_NO_SURFACE, EGL_NO_SURFACE, handles->context)){
+        std::cerr << "Could not create a surfaceless GL 4.3 context" << std::endl;
+        return false;
+    }
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX looks for an X display, the context itself is fine
+    if(err == GLEW_ERROR_NO_GLX_DISPLAY) err = glewContextInit();
+#endif
+    if(err != GLEW_OK){
+        std::cerr << "Glew error: " << glewGetErrorString(err) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::hasWorker(void) const {
+    return handles->worker_context != EGL_NO_CONTEXT;
+}
+
+bool HeadlessContext::makeWorkerCurrent(void){
+    return eglMakeCurrent(handles->display, EGL_NO_SURFACE, EGL_NO_SURFACE, handles->worker_context) == EGL_TRUE;
+}
+
+void HeadlessContext::releaseWorker(void){
+    eglMakeCurrent(handles->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// A GL 4.3 core context on EGL with no surface and no display, for the replay tool
+// and the tests that need GL. Kept apart like SharedContext, EGL can pull in Xlib.
+class HeadlessContext {
+    public:
+        HeadlessContext(void);
+        ~HeadlessContext(void);
+
+        // makes the context current and initialises glew, shared_worker also creates
+        // a second context sharing its textures for an upload worker
+        bool create(bool shared_worker = false);
+        bool hasWorker(void) const;
+        // on the worker thread
+        bool makeWorkerCurrent(void);
+        void releaseWorker(void);
+
+    private:
+        struct Handles;
+        Handles* handles;
+};
@@ -0,0 +1,119 @@
+#include "InputQueue.h"
+#include <algorithm>
+#include <string.h>
+
+InputQueue::InputQueue(void):mouse_x(0),mouse_y(0),move_time(0.0),move_pending(false),cached(false),
+    moved_window(NULL),moved_x(-1),moved_y(-1),captured(NULL),text_window(NULL){
+    events.reserve(64);
+    resetStats();
+}
+
+void InputQueue::mouseMoved(int x, int y, double time){
+    mouse_x = x;
+    mouse_y = y;
+    if(!move_pending) move_time = time;
+    move_pending = true;
+    input_stats.moves_received++;
+}
+
+void InputQueue::mouseButton(unsigned int button, bool down, double time){
+    Event event;
+    event.type = INPUT_BUTTON;
+    event.time = time;
+    event.x = mouse_x;
+    event.y = mouse_y;
+    event.button = button;
+    event.down = down;
+    event.character = 0;
+    events.push_back(event);
+}
+
+void InputQueue::character(wchar_t c, double time){
+    Event event;
+    event.type = INPUT_TEXT;
+    event.time = time;
+    event.x = mouse_x;
+    event.y = mouse_y;
+    event.button = 0;
+    event.down = false;
+    event.character = c;
+    events.push_back(event);
+}
+
+const InputTarget& InputQueue::targetAt(const Resolver& resolve, int x, int y){
+    if(!cached || x != cached_x || y != cached_y){
+        cached_target = resolve(x, y);
+        cached_x = x;
+        cached_y = y;
+        cached = true;
+    }
+    return cached_target;
+}
+
+void InputQueue::sendMove(const InputTarget& hit, int pointer_x, int pointer_y, const Projector& project){
+    InputTarget target = hit;
+    // a held button keeps the pointer in its window, off it the drag goes on at the
+    // projected position clamped to the page, or stays at the last one without a projection
+    if(captured && target.window != captured){
+        target.window = captured;
+        if(!project || !project(captured, pointer_x, pointer_y, target.s, target.t)) return;
+        target.s = std::max(0.0f, std::min(1.0f, target.s));
+        target.t = std::max(0.0f, std::min(1.0f, target.t));
+    }
+    if(!target.window) return;
+    int x = std::min<int>(target.s*target.window->pageWidth(), target.window->pageWidth() - 1);
+    int y = std::min<int>(target.t*target.window->pageHeight(), target.window->pageHeight() - 1);
+    if(target.window == moved_window && x == moved_x && y == moved_y) return;
+    target.window->mouseMoved(x, y);
+    moved_window = target.window;
+    moved_x = x;
+    moved_y = y;
+    input_stats.moves_sent++;
+}
+
+void InputQueue::sendText(void){
+    if(text_window && !text_run.empty()){
+        text_window->textEvent(text_run.data(), text_run.length());
+        input_stats.text_events++;
+    }
+    text_run.clear();
+    text_window = NULL;
+}
+
+InputTarget InputQueue::deliver(const Resolver& resolve, double now, const Projector& project){
+    // picks from last frame are stale, the camera may have moved since
+    cached = false;
+    if(move_pending) input_stats.max_latency = std::max(input_stats.max_latency, now - move_time);
+    move_pending = false;
+    for(size_t i = 0; i < events.size(); i++){
+        const Event& event = events[i];
+        input_stats.max_latency = std::max(input_stats.max_latency, now - event.time);
+        const InputTarget& target = targetAt(resolve, event.x, event.y);
+        if(event.type == INPUT_TEXT){
+            if(target.window != text_window) sendText();
+            text_window = target.window;
+            if(text_window) text_run += event.character;
+            input_stats.characters++;
+            continue;
+        }
+        // the page sees the pointer where the button changed, after the text typed before it
+        sendText();
+        sendMove(target, event.x, event.y, project);
+        GLTextureWindow* window = (captured && !event.down) ? captured : target.window;
+        if(window) window->mouseButton(event.button, event.down);
+        captured = event.down ? target.window : NULL;
+        input_stats.buttons++;
+    }
+    sendText();
+    events.clear();
+    InputTarget hover = targetAt(resolve, mouse_x, mouse_y);
+    sendMove(hover, mouse_x, mouse_y, project);
+    return hover;
+}
+
+const InputStats& InputQueue::stats(void) const {
+    return input_stats;
+}
+void InputQueue::resetStats(void){
+    memset(&input_stats, 0, sizeof(input_stats));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include "GLTextureWindow.h"
+
+// window under a point and the texture coordinates there, window NULL for nothing
+struct InputTarget {
+    GLTextureWindow* window;
+    float s, t;
+};
+
+// input counters, reset with InputQueue::resetStats()
+struct InputStats {
+    unsigned long moves_received;
+    unsigned long moves_sent;
+    unsigned long buttons;
+    unsigned long characters;
+    unsigned long text_events;
+    // seconds between an event arriving and being delivered
+    double max_latency;
+};
+
+// Queues the GLFW input events of a frame and hands them to the windows in one go
+// at a fixed point in the frame, in the order they arrived. Moves are folded into
+// the position of the event after them and a window only gets a move when the page
+// position under the pointer changed, whether the mouse or the camera moved it.
+// Runs of characters for the same window go out as a single textEvent. Every event
+// goes to the window under the pointer where it happened, except that the window a
+// button went down on keeps the pointer until it is released; moves off it during
+// such a drag still reach it, projected onto it or held at its edge.
+class InputQueue {
+    public:
+        // finds the window under a point in window pixels
+        typedef std::function<InputTarget(int x, int y)> Resolver;
+        // texture coordinates of a point on a window's plane, may lie outside 0..1;
+        // false when the window can't tell
+        typedef std::function<bool(GLTextureWindow* window, int x, int y, float& s, float& t)> Projector;
+
+        InputQueue(void);
+
+        // from the glfw callbacks, time in seconds
+        void mouseMoved(int x, int y, double time);
+        void mouseButton(unsigned int button, bool down, double time);
+        void character(wchar_t c, double time);
+
+        // delivers everything queued since the last call, call once per frame; returns
+        // what is under the pointer now. Without project, drags leaving the captured
+        // window stop at the last position on it
+        InputTarget deliver(const Resolver& resolve, double now, const Projector& project = Projector());
+
+        const InputStats& stats(void) const;
+        void resetStats(void);
+
+    private:
+        enum Type {
+            INPUT_BUTTON,
+            INPUT_TEXT
+        };
+        struct Event {
+            Type type;
+            double time;
+            int x, y;
+            unsigned int button;
+            bool down;
+            wchar_t character;
+        };
+
+        const InputTarget& targetAt(const Resolver& resolve, int x, int y);
+        void sendMove(const InputTarget& target, int x, int y, const Projector& project);
+        void sendText(void);
+
+        std::vector<Event> events;
+        int mouse_x, mouse_y;
+        // first move not delivered yet, for the latency
+        double move_time;
+        bool move_pending;
+        // the last resolved point, most events of a frame happen at the same one
+        bool cached;
+        int cached_x, cached_y;
+        InputTarget cached_target;
+        // page position the last move went to
+        GLTextureWindow* moved_window;
+        int moved_x, moved_y;
+        GLTextureWindow* captured;
+        GLTextureWindow* text_window;
+        std::wstring text_run;
+        InputStats input_stats;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+// Small helpers for column major 4x4 matrices as used by GL and gliby.
+
+// out = a * b, out may not alias a or b
+void matrixMultiply(float* out, const float* a, const float* b);
+// false when m is singular
+bool matrixInvert(float* out, const float* m);
+// transforms p (xyz) with w = 1 for points or 0 for directions, divides by w for points
+void matrixTransformPoint(float* out, const float* m, const float* p, float w);
+// transforms p (xyz, w = 1) to homogeneous clip coordinates
+void matrixTransformClip(float* out, const float* m, const float* p);
@@ -0,0 +1,136 @@
+#include "PaintTrace.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char TRACE_MAGIC[4] = {'P', 'T', 'R', 'C'};
+static const uint32_t TRACE_VERSION = 1;
+static const uint32_t TRACE_PIXELS = 1;
+
+static void packRect(int32_t* out, const Berkelium::Rect& r){
+    out[0] = r.left();
+    out[1] = r.top();
+    out[2] = r.width();
+    out[3] = r.height();
+}
+static Berkelium::Rect unpackRect(const int32_t* in){
+    Berkelium::Rect r;
+    r.mLeft = in[0];
+    r.mTop = in[1];
+    r.mWidth = in[2];
+    r.mHeight = in[3];
+    return r;
+}
+
+PaintTraceWriter::PaintTraceWriter(const std::string& path, unsigned int width, unsigned int height, bool pixels):
+    record_pixels(pixels),started(std::chrono::steady_clock::now()){
+    file = fopen(path.c_str(), "wb");
+    if(!file) return;
+    // paints come in bursts, let stdio batch the writes
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    PaintTraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.flags = record_pixels ? TRACE_PIXELS : 0;
+    fwrite(&header, sizeof(header), 1, file);
+}
+PaintTraceWriter::~PaintTraceWriter(void){
+    if(file) fclose(file);
+}
+
+bool PaintTraceWriter::good(void) const {
+    return file != NULL;
+}
+
+void PaintTraceWriter::record(const unsigned char* bitmap_in, const Berkelium::Rect& bitmap_rect, size_t num_copy_rects,
+    const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect& scroll_rect){
+    if(!file) return;
+    PaintTraceRecord rec;
+    rec.time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    packRect(rec.bitmap_rect, bitmap_rect);
+    rec.dx = dx;
+    rec.dy = dy;
+    packRect(rec.scroll_rect, scroll_rect);
+    rec.num_copy_rects = num_copy_rects;
+    rec.pixel_bytes = record_pixels ? bitmap_rect.width()*bitmap_rect.height()*4 : 0;
+    fwrite(&rec, sizeof(rec), 1, file);
+    for(size_t i = 0; i < num_copy_rects; i++){
+        int32_t packed[4];
+        packRect(packed, copy_rects[i]);
+        fwrite(packed, sizeof(packed), 1, file);
+    }
+    if(rec.pixel_bytes) fwrite(bitmap_in, 1, rec.pixel_bytes, file);
+}
+
+PaintTraceReader::PaintTraceReader(const std::string& path):data(NULL),size(0),offset(0){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PaintTraceHeader)){
+        void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped != MAP_FAILED){
+            data = (const unsigned char*)mapped;
+            size = st.st_size;
+            // records are read front to back
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if(!data) return;
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, TRACE_MAGIC, 4) != 0 || header.version != TRACE_VERSION){
+        munmap((void*)data, size);
+        data = NULL;
+        return;
+    }
+    offset = sizeof(header);
+}
+PaintTraceReader::~PaintTraceReader(void){
+    if(data) munmap((void*)data, size);
+}
+
+bool PaintTraceReader::good(void) const {
+    return data != NULL;
+}
+unsigned int PaintTraceReader::width(void) const {
+    return header.width;
+}
+unsigned int PaintTraceReader::height(void) const {
+    return header.height;
+}
+bool PaintTraceReader::hasPixels(void) const {
+    return header.flags & TRACE_PIXELS;
+}
+
+bool PaintTraceReader::next(PaintTraceEntry& entry){
+    if(!data || offset + sizeof(PaintTraceRecord) > size) return false;
+    PaintTraceRecord rec;
+    memcpy(&rec, data + offset, sizeof(rec));
+    size_t rects_bytes = rec.num_copy_rects*4*sizeof(int32_t);
+    if(offset + sizeof(rec) + rects_bytes + rec.pixel_bytes > size) return false;
+    offset += sizeof(rec);
+
+    entry.time_us = rec.time_us;
+    entry.bitmap_rect = unpackRect(rec.bitmap_rect);
+    entry.dx = rec.dx;
+    entry.dy = rec.dy;
+    entry.scroll_rect = unpackRect(rec.scroll_rect);
+    entry.copy_rects.resize(rec.num_copy_rects);
+    for(uint32_t i = 0; i < rec.num_copy_rects; i++){
+        int32_t packed[4];
+        memcpy(packed, data + offset + i*sizeof(packed), sizeof(packed));
+        entry.copy_rects[i] = unpackRect(packed);
+    }
+    offset += rects_bytes;
+    entry.pixels = rec.pixel_bytes ? data + offset : NULL;
+    offset += rec.pixel_bytes;
+    return true;
+}
+
+void PaintTraceReader::rewind(void){
+    if(data) offset = sizeof(header);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "berkelium/Rect.hpp"
+
+// Trace of the paints a window received, for replaying the upload path without a
+// browser. The file is a PaintTraceHeader followed by one record per paint:
+// a PaintTraceRecord, its copy rects and, when recorded, the bitmap pixels.
+// Rects are stored as left, top, width, height.
+struct PaintTraceHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t flags;
+};
+struct PaintTraceRecord {
+    uint64_t time_us;
+    int32_t bitmap_rect[4];
+    int32_t dx, dy;
+    int32_t scroll_rect[4];
+    uint32_t num_copy_rects;
+    uint32_t pixel_bytes;
+};
+
+// one paint read back from a trace, pixels point into the mapped file
+struct PaintTraceEntry {
+    uint64_t time_us;
+    Berkelium::Rect bitmap_rect;
+    std::vector<Berkelium::Rect> copy_rects;
+    int dx, dy;
+    Berkelium::Rect scroll_rect;
+    const unsigned char* pixels;
+};
+
+// Appends paints to a trace file. Not thread safe, record from the thread that paints.
+class PaintTraceWriter {
+    public:
+        // without pixels only the rects are kept, replays then upload a test pattern
+        PaintTraceWriter(const std::string& path, unsigned int width, unsigned int height, bool pixels = true);
+        ~PaintTraceWriter(void);
+
+        bool good(void) const;
+        void record(const unsigned char* bitmap_in, const Berkelium::Rect& bitmap_rect, size_t num_copy_rects,
+            const Berkelium::Rect* copy_rects, int dx, int dy, const Berkelium::Rect& scroll_rect);
+
+    private:
+        FILE* file;
+        bool record_pixels;
+        std::chrono::steady_clock::time_point started;
+};
+
+// Memory maps a trace file and walks its records.
+class PaintTraceReader {
+    public:
+        PaintTraceReader(const std::string& path);
+        ~PaintTraceReader(void);
+
+        bool good(void) const;
+        unsigned int width(void) const;
+        unsigned int height(void) const;
+        bool hasPixels(void) const;
+        // false at the end of the trace or on a truncated record
+        bool next(PaintTraceEntry& entry);
+        void rewind(void);
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        size_t offset;
+        PaintTraceHeader header;
+};
@@ -0,0 +1,68 @@
+#include "PanelInstancer.h"
+#include <string.h>
+
+PanelInstancer::PanelInstancer(const GLfloat* verts, const GLfloat* texcoords, int count, unsigned int max):
+    vertex_count(count),max_panels(max){
+
+    // interleave position and texture coordinates, attribute slots match the shader attributes
+    std::vector<GLfloat> data;
+    for(int i = 0; i < count; i++){
+        data.insert(data.end(), verts + i*3, verts + i*3 + 3);
+        data.insert(data.end(), texcoords + i*2, texcoords + i*2 + 2);
+    }
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, data.size()*sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat), (const GLvoid*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat), (const GLvoid*)(3*sizeof(GLfloat)));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &panel_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, panel_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PanelData)*max_panels, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    panels.reserve(max_panels);
+}
+PanelInstancer::~PanelInstancer(void){
+    glDeleteBuffers(1, &panel_buffer);
+    glDeleteBuffers(1, &vertex_buffer);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void PanelInstancer::begin(void){
+    panels.clear();
+}
+
+void PanelInstancer::add(const float* mvp, int index, int layer){
+    if(panels.size() >= max_panels) return;
+    PanelData panel;
+    memcpy(panel.mvp, mvp, sizeof(panel.mvp));
+    panel.index = index;
+    panel.layer = layer;
+    panels.push_back(panel);
+}
+
+void PanelInstancer::upload(void){
+    if(panels.empty()) return;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, panel_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PanelData)*max_panels, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PanelData)*panels.size(), &panels[0]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void PanelInstancer::draw(const ProgramInfo& program, GLuint array_texture){
+    if(panels.empty()) return;
+    glUseProgram(program.program);
+    glActiveTexture(GL_TEXTURE0 + RenderQueue::ARRAY_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PANEL_BINDING, panel_buffer);
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, vertex_count, panels.size());
+    glBindVertexArray(0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "RenderQueue.h"
+
+// Draws every panel quad that samples from a texture array with one instanced
+// call. Per panel data lives in a shader storage buffer indexed by gl_InstanceID.
+class PanelInstancer {
+    public:
+        // binding point of the Panels storage block
+        static const GLuint PANEL_BINDING = 1;
+
+        // verts and texcoords of the quad as a triangle fan, like the batch it replaces
+        PanelInstancer(const GLfloat* verts, const GLfloat* texcoords, int vertex_count, unsigned int max_panels = 256);
+        ~PanelInstancer(void);
+
+        void begin(void);
+        void add(const float* mvp, int index, int layer);
+        void upload(void);
+        void draw(const ProgramInfo& program, GLuint array_texture);
+
+    private:
+        // std430 layout of PanelData
+        struct PanelData {
+            GLfloat mvp[16];
+            GLint index;
+            GLint layer;
+            GLint padding[2];
+        };
+
+        GLuint vao;
+        GLuint vertex_buffer;
+        GLuint panel_buffer;
+        int vertex_count;
+        unsigned int max_panels;
+        std::vector<PanelData> panels;
+};
@@ -0,0 +1,326 @@
+#include "PixelConvert.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+// round(c*a/255) without a division
+static inline unsigned char mulDiv255(unsigned int c, unsigned int a){
+    unsigned int t = c*a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static void copyScalar(unsigned char* dst, const unsigned char* src, size_t count){
+    if(dst != src) memcpy(dst, src, count*4);
+}
+static void swizzleScalar(unsigned char* dst, const unsigned char* src, size_t count){
+    for(size_t i = 0; i < count*4; i += 4){
+        unsigned char first = src[i];
+        dst[i] = src[i+2];
+        dst[i+1] = src[i+1];
+        dst[i+2] = first;
+        dst[i+3] = src[i+3];
+    }
+}
+static void premultiplyScalar(unsigned char* dst, const unsigned char* src, size_t count){
+    for(size_t i = 0; i < count*4; i += 4){
+        unsigned int a = src[i+3];
+        dst[i] = mulDiv255(src[i], a);
+        dst[i+1] = mulDiv255(src[i+1], a);
+        dst[i+2] = mulDiv255(src[i+2], a);
+        dst[i+3] = a;
+    }
+}
+// float math on purpose, the vector kernels do exactly the same
+static void unpremultiplyScalar(unsigned char* dst, const unsigned char* src, size_t count){
+    for(size_t i = 0; i < count*4; i += 4){
+        unsigned char a = src[i+3];
+        float scale = a ? 255.0f/(float)a : 0.0f;
+        for(int c = 0; c < 3; c++){
+            long v = lrintf((float)src[i+c]*scale);
+            dst[i+c] = v > 255 ? 255 : v;
+        }
+        dst[i+3] = a;
+    }
+}
+
+#ifdef PIXEL_X86
+__attribute__((target("sse2")))
+static void swizzleSse2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    const __m128i ag = _mm_set1_epi32(0xFF00FF00);
+    const __m128i rb = _mm_set1_epi32(0x00FF00FF);
+    for(; i + 4 <= count; i += 4){
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i*4));
+        __m128i swapped = _mm_and_si128(rb, _mm_or_si128(_mm_slli_epi32(p, 16), _mm_srli_epi32(p, 16)));
+        _mm_storeu_si128((__m128i*)(dst + i*4), _mm_or_si128(_mm_and_si128(p, ag), swapped));
+    }
+    swizzleScalar(dst + i*4, src + i*4, count - i);
+}
+__attribute__((target("sse2")))
+static inline __m128i premultiplyHalfSse2(__m128i p){
+    // p holds two pixels as 16 bit channels, alpha goes to every lane but its own
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+    const __m128i alpha_lanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i color_lanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    alpha = _mm_or_si128(_mm_and_si128(alpha, color_lanes), alpha_lanes);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(p, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+__attribute__((target("sse2")))
+static void premultiplySse2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4){
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i*4));
+        __m128i lo = premultiplyHalfSse2(_mm_unpacklo_epi8(p, zero));
+        __m128i hi = premultiplyHalfSse2(_mm_unpackhi_epi8(p, zero));
+        _mm_storeu_si128((__m128i*)(dst + i*4), _mm_packus_epi16(lo, hi));
+    }
+    premultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+__attribute__((target("sse2")))
+static inline __m128i unpremultiplyPixelSse2(__m128i channels){
+    // one pixel as 32 bit lanes
+    __m128 p = _mm_cvtepi32_ps(channels);
+    __m128 alpha = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3,3,3,3));
+    __m128 scale = _mm_and_ps(_mm_div_ps(_mm_set1_ps(255.0f), alpha), _mm_cmpneq_ps(alpha, _mm_setzero_ps()));
+    // alpha itself stays
+    const __m128 alpha_lane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    scale = _mm_or_ps(_mm_andnot_ps(alpha_lane, scale), _mm_and_ps(alpha_lane, _mm_set1_ps(1.0f)));
+    return _mm_cvtps_epi32(_mm_mul_ps(p, scale));
+}
+__attribute__((target("sse2")))
+static void unpremultiplySse2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= count; i += 4){
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i*4));
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        __m128i p0 = unpremultiplyPixelSse2(_mm_unpacklo_epi16(lo, zero));
+        __m128i p1 = unpremultiplyPixelSse2(_mm_unpackhi_epi16(lo, zero));
+        __m128i p2 = unpremultiplyPixelSse2(_mm_unpacklo_epi16(hi, zero));
+        __m128i p3 = unpremultiplyPixelSse2(_mm_unpackhi_epi16(hi, zero));
+        // saturating packs clamp to 255
+        _mm_storeu_si128((__m128i*)(dst + i*4), _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+    }
+    unpremultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swizzleAvx2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    const __m256i shuffle = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15,
+        2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+    for(; i + 8 <= count; i += 8){
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + i*4));
+        _mm256_storeu_si256((__m256i*)(dst + i*4), _mm256_shuffle_epi8(p, shuffle));
+    }
+    swizzleScalar(dst + i*4, src + i*4, count - i);
+}
+__attribute__((target("avx2")))
+static inline __m256i premultiplyHalfAvx2(__m256i p){
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+    const __m256i alpha_lanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    alpha = _mm256_blend_epi16(alpha, alpha_lanes, 0x88);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(p, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+__attribute__((target("avx2")))
+static void premultiplyAvx2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    const __m256i zero = _mm256_setzero_si256();
+    for(; i + 8 <= count; i += 8){
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + i*4));
+        // unpack and pack both work per 128 bit lane, so pixel order survives
+        __m256i lo = premultiplyHalfAvx2(_mm256_unpacklo_epi8(p, zero));
+        __m256i hi = premultiplyHalfAvx2(_mm256_unpackhi_epi8(p, zero));
+        _mm256_storeu_si256((__m256i*)(dst + i*4), _mm256_packus_epi16(lo, hi));
+    }
+    premultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+__attribute__((target("avx2")))
+static inline __m256i unpremultiplyPairAvx2(__m256i channels){
+    // two pixels as 32 bit lanes, one per 128 bit lane
+    __m256 p = _mm256_cvtepi32_ps(channels);
+    __m256 alpha = _mm256_permute_ps(p, _MM_SHUFFLE(3,3,3,3));
+    __m256 scale = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(255.0f), alpha), _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_NEQ_UQ));
+    scale = _mm256_blend_ps(scale, _mm256_set1_ps(1.0f), 0x88);
+    return _mm256_cvtps_epi32(_mm256_mul_ps(p, scale));
+}
+__attribute__((target("avx2")))
+static void unpremultiplyAvx2(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        const unsigned char* s = src + i*4;
+        __m256i p0 = unpremultiplyPairAvx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)s)));
+        __m256i p1 = unpremultiplyPairAvx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + 8))));
+        __m256i p2 = unpremultiplyPairAvx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + 16))));
+        __m256i p3 = unpremultiplyPairAvx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + 24))));
+        // packs interleave the 128 bit lanes, put the pixels back in order afterwards
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)(dst + i*4), packed);
+    }
+    unpremultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+#endif
+
+#ifdef PIXEL_NEON
+static void swizzleNeon(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        uint8x16x4_t p = vld4q_u8(src + i*4);
+        uint8x16_t first = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = first;
+        vst4q_u8(dst + i*4, p);
+    }
+    swizzleScalar(dst + i*4, src + i*4, count - i);
+}
+// round(c*a/255) for eight channels, same rounding as mulDiv255
+static inline uint8x8_t mulDiv255Neon(uint8x8_t c, uint8x8_t a){
+    uint16x8_t t = vmull_u8(c, a);
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+static void premultiplyNeon(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        uint8x8x4_t p = vld4_u8(src + i*4);
+        p.val[0] = mulDiv255Neon(p.val[0], p.val[3]);
+        p.val[1] = mulDiv255Neon(p.val[1], p.val[3]);
+        p.val[2] = mulDiv255Neon(p.val[2], p.val[3]);
+        vst4_u8(dst + i*4, p);
+    }
+    premultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+#ifdef __aarch64__
+// four channels of four pixels
+static inline uint16x4_t unpremultiplyNeon(uint16x4_t c, float32x4_t scale){
+    float32x4_t v = vmulq_f32(vcvtq_f32_u32(vmovl_u16(c)), scale);
+    return vqmovn_u32(vcvtnq_u32_f32(v));
+}
+static void unpremultiplyNeonA64(unsigned char* dst, const unsigned char* src, size_t count){
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        uint8x8x4_t p = vld4_u8(src + i*4);
+        uint16x8_t a = vmovl_u8(p.val[3]);
+        float32x4_t a_lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(a)));
+        float32x4_t a_hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(a)));
+        float32x4_t zero = vdupq_n_f32(0.0f);
+        float32x4_t s_lo = vbslq_f32(vceqq_f32(a_lo, zero), zero, vdivq_f32(vdupq_n_f32(255.0f), a_lo));
+        float32x4_t s_hi = vbslq_f32(vceqq_f32(a_hi, zero), zero, vdivq_f32(vdupq_n_f32(255.0f), a_hi));
+        for(int c = 0; c < 3; c++){
+            uint16x8_t channel = vmovl_u8(p.val[c]);
+            uint16x8_t result = vcombine_u16(unpremultiplyNeon(vget_low_u16(channel), s_lo), unpremultiplyNeon(vget_high_u16(channel), s_hi));
+            p.val[c] = vqmovn_u16(result);
+        }
+        vst4_u8(dst + i*4, p);
+    }
+    unpremultiplyScalar(dst + i*4, src + i*4, count - i);
+}
+#endif
+#endif
+
+static PixelIsa detectIsa(void){
+#ifdef PIXEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return ISA_AVX2;
+    if(__builtin_cpu_supports("sse2")) return ISA_SSE2;
+#elif defined(PIXEL_NEON)
+    return ISA_NEON;
+#endif
+    return ISA_SCALAR;
+}
+static PixelIsa isa(void){
+    static PixelIsa detected = detectIsa();
+    return detected;
+}
+
+PixelKernel pixelKernelScalar(PixelOp op){
+    switch(op){
+        case PIXEL_SWIZZLE: return swizzleScalar;
+        case PIXEL_PREMULTIPLY: return premultiplyScalar;
+        case PIXEL_UNPREMULTIPLY: return unpremultiplyScalar;
+        default: return copyScalar;
+    }
+}
+
+bool pixelIsaSupported(PixelIsa which){
+    switch(which){
+#ifdef PIXEL_X86
+        case ISA_AVX2: return isa() == ISA_AVX2;
+        case ISA_SSE2: return isa() == ISA_AVX2 || isa() == ISA_SSE2;
+#endif
+#ifdef PIXEL_NEON
+        case ISA_NEON: return true;
+#endif
+        case ISA_SCALAR: return true;
+        default: return false;
+    }
+}
+
+PixelKernel pixelKernel(PixelOp op){
+    return pixelKernel(op, isa());
+}
+
+PixelKernel pixelKernel(PixelOp op, PixelIsa which){
+    switch(which){
+#ifdef PIXEL_X86
+        case ISA_AVX2:
+            if(op == PIXEL_SWIZZLE) return swizzleAvx2;
+            if(op == PIXEL_PREMULTIPLY) return premultiplyAvx2;
+            if(op == PIXEL_UNPREMULTIPLY) return unpremultiplyAvx2;
+            break;
+        case ISA_SSE2:
+            if(op == PIXEL_SWIZZLE) return swizzleSse2;
+            if(op == PIXEL_PREMULTIPLY) return premultiplySse2;
+            if(op == PIXEL_UNPREMULTIPLY) return unpremultiplySse2;
+            break;
+#endif
+#ifdef PIXEL_NEON
+        case ISA_NEON:
+            if(op == PIXEL_SWIZZLE) return swizzleNeon;
+            if(op == PIXEL_PREMULTIPLY) return premultiplyNeon;
+#ifdef __aarch64__
+            if(op == PIXEL_UNPREMULTIPLY) return unpremultiplyNeonA64;
+#endif
+            break;
+#endif
+        default:
+            break;
+    }
+    return pixelKernelScalar(op);
+}
+
+const char* pixelKernelIsa(void){
+    return pixelIsaName(isa());
+}
+
+const char* pixelIsaName(PixelIsa which){
+    switch(which){
+        case ISA_AVX2: return "avx2";
+        case ISA_SSE2: return "sse2";
+        case ISA_NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+void convertPixelRect(PixelOp op, unsigned char* dst, size_t dst_stride, const unsigned char* src, size_t src_stride, int width, int height){
+    // contiguous blocks go through in one call
+    if(dst_stride == (size_t)width*4 && src_stride == (size_t)width*4){
+        pixelKernel(op)(dst, src, (size_t)width*height);
+        return;
+    }
+    PixelKernel kernel = pixelKernel(op);
+    for(int row = 0; row < height; row++){
+        kernel(dst + row*dst_stride, src + row*src_stride, width);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+// Per pixel conversions for 4 byte pixels with alpha last (BGRA or RGBA), run while
+// paints are copied. Every operation has a scalar reference and SSE2, AVX2 or NEON
+// versions, the fastest one the CPU supports is picked at runtime.
+enum PixelOp {
+    PIXEL_COPY,          // plain copy
+    PIXEL_SWIZZLE,       // swap the first and third byte, BGRA <-> RGBA
+    PIXEL_PREMULTIPLY,   // straight alpha to premultiplied, rounded
+    PIXEL_UNPREMULTIPLY  // premultiplied to straight alpha, zero alpha gives black
+};
+
+enum PixelIsa {
+    ISA_SCALAR,
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_NEON
+};
+
+// converts count pixels, dst and src may be the same but may not overlap otherwise
+typedef void (*PixelKernel)(unsigned char* dst, const unsigned char* src, size_t count);
+
+// fastest kernel for this CPU
+PixelKernel pixelKernel(PixelOp op);
+// kernel of one instruction set, scalar where it has none for op, check pixelIsaSupported() first
+PixelKernel pixelKernel(PixelOp op, PixelIsa isa);
+// reference the vector kernels match bit for bit
+PixelKernel pixelKernelScalar(PixelOp op);
+// whether this build and CPU can run isa
+bool pixelIsaSupported(PixelIsa isa);
+// "avx2", "sse2", "neon" or "scalar"
+const char* pixelKernelIsa(void);
+const char* pixelIsaName(PixelIsa isa);
+// converts a width x height block, strides in bytes
+void convertPixelRect(PixelOp op, unsigned char* dst, size_t dst_stride, const unsigned char* src, size_t src_stride, int width, int height);
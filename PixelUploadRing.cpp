@@ -0,0 +1,76 @@
+#include "PixelUploadRing.h"
+
+PixelUploadRing::PixelUploadRing(size_t size, unsigned int slots):
+    slot_size(size),current(0),mapped(NULL),fences(slots, (GLsync)0),stall_count(0),profiler(NULL),map_phase(0){
+
+    persistent_map = GLEW_ARB_buffer_storage;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    if(persistent_map){
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_size*slots, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_size*slots, flags);
+    }else{
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_size*slots, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+PixelUploadRing::~PixelUploadRing(void){
+    for(size_t i = 0; i < fences.size(); i++){
+        if(fences[i]) glDeleteSync(fences[i]);
+    }
+    if(persistent_map){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+unsigned char* PixelUploadRing::begin(size_t bytes){
+    if(bytes > slot_size) return NULL;
+    ProfileScope scope(profiler, map_phase);
+    current = (current + 1) % fences.size();
+    // wait until the GPU is done with the last upload from this slot
+    if(fences[current]){
+        if(glClientWaitSync(fences[current], 0, 0) == GL_TIMEOUT_EXPIRED){
+            stall_count++;
+            while(glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fences[current]);
+        fences[current] = 0;
+    }
+    if(persistent_map) return mapped + current*slot_size;
+    // fencing keeps track of the slot, no need to let the driver synchronise
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    unsigned char* ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, current*slot_size, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return ptr;
+}
+
+const unsigned char* PixelUploadRing::end(void){
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    if(!persistent_map) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return (const unsigned char*)(current*slot_size);
+}
+
+void PixelUploadRing::release(void){
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+size_t PixelUploadRing::slotSize(void) const {
+    return slot_size;
+}
+bool PixelUploadRing::persistent(void) const {
+    return persistent_map;
+}
+unsigned long PixelUploadRing::stalls(void) const {
+    return stall_count;
+}
+
+void PixelUploadRing::setProfiler(FrameProfiler* prof){
+    profiler = prof;
+    if(profiler) map_phase = profiler->phase("pbo map");
+}
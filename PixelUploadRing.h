@@ -0,0 +1,42 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <stddef.h>
+#include "FrameProfiler.h"
+
+// Ring of pixel unpack buffer slots for asynchronous texture uploads. Pixel data
+// is written into a slot, the slot is bound as GL_PIXEL_UNPACK_BUFFER for the
+// glTex(Sub)Image calls and then fenced, a slot is only written again once the
+// GPU is done reading from it. The buffer stays persistently mapped when
+// ARB_buffer_storage is available, otherwise each slot is mapped on demand.
+class PixelUploadRing {
+    public:
+        PixelUploadRing(size_t slot_size, unsigned int slots = 3);
+        ~PixelUploadRing(void);
+
+        // returns a write pointer for the next slot, NULL when bytes does not fit a slot
+        unsigned char* begin(size_t bytes);
+        // binds the buffer, the returned pointer is the slot offset to pass to glTex*Image
+        const unsigned char* end(void);
+        // fences the slot after the upload calls and unbinds the buffer
+        void release(void);
+
+        size_t slotSize(void) const;
+        bool persistent(void) const;
+        // number of times begin() had to wait for the GPU
+        unsigned long stalls(void) const;
+        // times waiting for and mapping slots as the "pbo map" phase
+        void setProfiler(FrameProfiler* profiler);
+
+    private:
+        GLuint buffer;
+        size_t slot_size;
+        unsigned int current;
+        bool persistent_map;
+        unsigned char* mapped;
+        std::vector<GLsync> fences;
+        unsigned long stall_count;
+        FrameProfiler* profiler;
+        int map_phase;
+};
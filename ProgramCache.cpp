@@ -0,0 +1,214 @@
+#include "ProgramCache.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// start of every cache file, the binary follows
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+    double compile_seconds;
+};
+static const uint32_t CACHE_VERSION = 1;
+
+// 64 bit FNV-1a, strings are hashed with their terminator so "ab"+"c" != "a"+"bc"
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t length){
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < length; i++){
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+static uint64_t hashString(uint64_t hash, const std::string& str){
+    return hashBytes(hash, str.c_str(), str.length() + 1);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()/1e6;
+}
+
+ProgramCache::ProgramCache(const std::string& dir, const std::vector<const char*>* paths):directory(dir){
+    if(!directory.empty() && directory[directory.length() - 1] != '/') directory += '/';
+    mkdir(directory.c_str(), 0755);
+    if(paths) search_path.assign(paths->begin(), paths->end());
+    const GLubyte* strings[] = {glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION)};
+    for(int i = 0; i < 3; i++){
+        if(strings[i]) driver += (const char*)strings[i];
+        driver += '\n';
+    }
+    GLint formats = 0;
+    if(GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    binaries = formats > 0;
+    resetStats();
+}
+
+bool ProgramCache::readSource(const char* name, std::string& source) const {
+    for(size_t i = 0; i <= search_path.size(); i++){
+        // the name as given last, it may be a path of its own
+        std::string path = i < search_path.size() ? search_path[i] + name : std::string(name);
+        std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+        if(!file) continue;
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        source = contents.str();
+        return true;
+    }
+    std::cerr << "Shader " << name << " not found" << std::endl;
+    return false;
+}
+
+GLuint ProgramCache::buildShaderPair(const char* vp, const char* fp, int num_attrs, const gliby::ShaderAttribute* attrs){
+    std::string vp_source, fp_source;
+    if(!readSource(vp, vp_source) || !readSource(fp, fp_source)) return 0;
+    uint64_t key = hashString(14695981039346656037ull, driver);
+    key = hashString(key, vp_source);
+    key = hashString(key, fp_source);
+    for(int i = 0; i < num_attrs; i++){
+        key = hashBytes(key, &attrs[i].index, sizeof(attrs[i].index));
+        key = hashString(key, attrs[i].name);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    std::string path = directory + name;
+
+    if(binaries){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double compile_seconds;
+        GLuint program = load(path, key, &compile_seconds);
+        if(program){
+            double seconds = secondsSince(start);
+            cache_stats.hits++;
+            cache_stats.load_seconds += seconds;
+            cache_stats.saved_seconds += compile_seconds - seconds;
+            return program;
+        }
+    }
+    cache_stats.misses++;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GLuint program = compile(vp_source, fp_source, num_attrs, attrs);
+    double seconds = secondsSince(start);
+    cache_stats.compile_seconds += seconds;
+    if(!program) std::cerr << "Building " << vp << " + " << fp << " failed" << std::endl;
+    else if(binaries) store(path, key, program, seconds);
+    return program;
+}
+
+static GLuint compileShader(GLenum type, const std::string& source){
+    GLuint shader = glCreateShader(type);
+    const GLchar* text = source.c_str();
+    glShaderSource(shader, 1, &text, NULL);
+    glCompileShader(shader);
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if(!status){
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        std::cerr << "Shader compile error: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint ProgramCache::compile(const std::string& vp, const std::string& fp, int num_attrs, const gliby::ShaderAttribute* attrs){
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, vp);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fp);
+    if(!vertex || !fragment){
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    for(int i = 0; i < num_attrs; i++) glBindAttribLocation(program, attrs[i].index, attrs[i].name);
+    // some drivers only keep a binary around when asked before linking
+    if(binaries) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDetachShader(program, vertex);
+    glDetachShader(program, fragment);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(!status){
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cerr << "Program link error: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GLuint ProgramCache::load(const std::string& path, uint64_t key, double* compile_seconds){
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return 0;
+    ProgramCacheHeader header;
+    std::vector<unsigned char> binary;
+    bool good = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, "GLPB", 4)
+        && header.version == CACHE_VERSION && header.key == key && header.length > 0;
+    if(good){
+        binary.resize(header.length);
+        good = fread(&binary[0], 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if(!good) return 0;
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, &binary[0], binary.size());
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(!status){
+        // format the driver no longer takes, compiled and written again
+        glDeleteProgram(program);
+        cache_stats.rejected++;
+        return 0;
+    }
+    *compile_seconds = header.compile_seconds;
+    return program;
+}
+
+void ProgramCache::store(const std::string& path, uint64_t key, GLuint program, double compile_seconds){
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+    std::vector<unsigned char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+    ProgramCacheHeader header;
+    memcpy(header.magic, "GLPB", 4);
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = length;
+    header.compile_seconds = compile_seconds;
+    // written next to it and renamed, a crash halfway leaves no torn file behind
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if(!file) return;
+    bool good = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&binary[0], 1, length, file) == (size_t)length;
+    good = fclose(file) == 0 && good;
+    if(good) good = rename(temp.c_str(), path.c_str()) == 0;
+    if(!good){
+        remove(temp.c_str());
+        std::cerr << "Could not write program cache " << path << std::endl;
+    }
+}
+
+bool ProgramCache::enabled(void) const {
+    return binaries;
+}
+const ProgramCacheStats& ProgramCache::stats(void) const {
+    return cache_stats;
+}
+void ProgramCache::resetStats(void){
+    memset(&cache_stats, 0, sizeof(cache_stats));
+}
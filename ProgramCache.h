@@ -0,0 +1,52 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "ShaderManager.h"
+
+// program cache counters, reset with ProgramCache::resetStats()
+struct ProgramCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    // binaries the driver turned down, counted as misses too
+    unsigned long rejected;
+    double load_seconds;
+    double compile_seconds;
+    // what compiling the hits took when they were cached, minus loading them now
+    double saved_seconds;
+};
+
+// Builds shader pairs like gliby::ShaderManager::buildShaderPair, but keeps every
+// linked program in a directory as the driver's program binary. The file name is a
+// hash of both sources, the attribute bindings and the GL vendor, renderer and
+// version, so any change to those compiles again. Binaries the driver won't take
+// back, after an update it didn't announce in its version string for one, are
+// compiled and replaced as well. Without binary formats it only compiles.
+class ProgramCache {
+    public:
+        // shader files are looked up in search_path like the ShaderManager does,
+        // directory is created when missing
+        ProgramCache(const std::string& directory, const std::vector<const char*>* search_path);
+
+        // a linked program, 0 when a source is missing or doesn't compile
+        GLuint buildShaderPair(const char* vp, const char* fp, int num_attrs, const gliby::ShaderAttribute* attrs);
+
+        bool enabled(void) const;
+        const ProgramCacheStats& stats(void) const;
+        void resetStats(void);
+
+    private:
+        bool readSource(const char* name, std::string& source) const;
+        GLuint compile(const std::string& vp, const std::string& fp, int num_attrs, const gliby::ShaderAttribute* attrs);
+        GLuint load(const std::string& path, uint64_t key, double* compile_seconds);
+        void store(const std::string& path, uint64_t key, GLuint program, double compile_seconds);
+
+        std::string directory;
+        std::vector<std::string> search_path;
+        // vendor, renderer and version, part of every key
+        std::string driver;
+        bool binaries;
+        ProgramCacheStats cache_stats;
+};
@@ -0,0 +1,338 @@
+#include "RayPicker.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include "MatrixUtil.h"
+
+// slab test, returns the entry distance or FLT_MAX
+static float intersectBox(const float* min, const float* max, const float* origin, const float* inv_dir){
+    float tmin = 0.0f, tmax = FLT_MAX;
+    for(int i = 0; i < 3; i++){
+        float t0 = (min[i] - origin[i])*inv_dir[i];
+        float t1 = (max[i] - origin[i])*inv_dir[i];
+        if(t0 > t1) std::swap(t0, t1);
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+        if(tmin > tmax) return FLT_MAX;
+    }
+    return tmin;
+}
+
+void PickMesh::computeBounds(void){
+    for(int i = 0; i < 3; i++){
+        bounds_min[i] = FLT_MAX;
+        bounds_max[i] = -FLT_MAX;
+    }
+    for(size_t v = 0; v < positions.size(); v += 3){
+        for(int i = 0; i < 3; i++){
+            bounds_min[i] = std::min(bounds_min[i], positions[v+i]);
+            bounds_max[i] = std::max(bounds_max[i], positions[v+i]);
+        }
+    }
+}
+
+PickMesh* PickMesh::fromTriangleFan(const float* verts, const float* coords, int count){
+    PickMesh* mesh = new PickMesh();
+    mesh->positions.assign(verts, verts + count*3);
+    mesh->texcoords.assign(coords, coords + count*2);
+    for(int i = 1; i + 1 < count; i++){
+        mesh->indices.push_back(0);
+        mesh->indices.push_back(i);
+        mesh->indices.push_back(i+1);
+    }
+    mesh->computeBounds();
+    return mesh;
+}
+
+RayPicker::RayPicker(void){
+}
+RayPicker::~RayPicker(void){
+}
+
+int RayPicker::addTarget(gliby::Actor* actor, const PickMesh* mesh, GLTextureWindow* window){
+    Target target;
+    target.actor = actor;
+    target.mesh = mesh;
+    target.radius = 0.0f;
+    target.window = window;
+    // a matrix no actor has, so the first update takes the real one
+    std::fill(target.model, target.model + 16, NAN);
+    targets.push_back(target);
+    return targets.size() - 1;
+}
+
+int RayPicker::addSphere(gliby::Actor* actor, float radius, GLTextureWindow* window){
+    Target target;
+    target.actor = actor;
+    target.mesh = NULL;
+    target.radius = radius;
+    target.window = window;
+    std::fill(target.model, target.model + 16, NAN);
+    targets.push_back(target);
+    return targets.size() - 1;
+}
+
+bool RayPicker::updateBounds(Target& target){
+    Math3D::Matrix44f model;
+    target.actor->getFrame().getMatrix(model);
+    if(memcmp(target.model, model, sizeof(target.model)) == 0) return false;
+    memcpy(target.model, model, sizeof(target.model));
+    matrixInvert(target.inverse_model, model);
+    // world bounds from the transformed corners of the local bounds
+    float lmin[3], lmax[3];
+    for(int a = 0; a < 3; a++){
+        lmin[a] = target.mesh ? target.mesh->bounds_min[a] : -target.radius;
+        lmax[a] = target.mesh ? target.mesh->bounds_max[a] : target.radius;
+        target.world_min[a] = FLT_MAX;
+        target.world_max[a] = -FLT_MAX;
+    }
+    for(int c = 0; c < 8; c++){
+        float corner[3] = {(c & 1) ? lmax[0] : lmin[0], (c & 2) ? lmax[1] : lmin[1], (c & 4) ? lmax[2] : lmin[2]};
+        float world[3];
+        matrixTransformPoint(world, model, corner, 1.0f);
+        for(int a = 0; a < 3; a++){
+            target.world_min[a] = std::min(target.world_min[a], world[a]);
+            target.world_max[a] = std::max(target.world_max[a], world[a]);
+        }
+    }
+    return true;
+}
+
+void RayPicker::update(void){
+    for(size_t i = 0; i < targets.size(); i++) updateBounds(targets[i]);
+    order.resize(targets.size());
+    for(size_t i = 0; i < order.size(); i++) order[i] = i;
+    nodes.clear();
+    if(!targets.empty()) build(0, targets.size());
+}
+
+void RayPicker::refit(void){
+    bool moved = false;
+    for(size_t i = 0; i < targets.size(); i++){
+        if(updateBounds(targets[i])) moved = true;
+    }
+    if(!moved) return;
+    // children always come after their parent, so going backwards refits bottom up
+    for(size_t n = nodes.size(); n-- > 0;){
+        Node& node = nodes[n];
+        for(int a = 0; a < 3; a++){
+            node.min[a] = FLT_MAX;
+            node.max[a] = -FLT_MAX;
+        }
+        if(node.left < 0){
+            for(int i = node.first; i < node.first + node.count; i++){
+                const Target& target = targets[order[i]];
+                for(int a = 0; a < 3; a++){
+                    node.min[a] = std::min(node.min[a], target.world_min[a]);
+                    node.max[a] = std::max(node.max[a], target.world_max[a]);
+                }
+            }
+        }else{
+            const Node& left = nodes[node.left];
+            const Node& right = nodes[node.right];
+            for(int a = 0; a < 3; a++){
+                node.min[a] = std::min(left.min[a], right.min[a]);
+                node.max[a] = std::max(left.max[a], right.max[a]);
+            }
+        }
+    }
+}
+
+// median split along the longest axis of the node bounds
+int RayPicker::build(int first, int count){
+    Node node;
+    for(int a = 0; a < 3; a++){
+        node.min[a] = FLT_MAX;
+        node.max[a] = -FLT_MAX;
+    }
+    for(int i = first; i < first + count; i++){
+        const Target& target = targets[order[i]];
+        for(int a = 0; a < 3; a++){
+            node.min[a] = std::min(node.min[a], target.world_min[a]);
+            node.max[a] = std::max(node.max[a], target.world_max[a]);
+        }
+    }
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+    int index = nodes.size();
+    nodes.push_back(node);
+    if(count <= 2) return index;
+
+    int axis = 0;
+    for(int a = 1; a < 3; a++){
+        if(node.max[a] - node.min[a] > node.max[axis] - node.min[axis]) axis = a;
+    }
+    int half = count / 2;
+    const std::vector<Target>& t = targets;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+        [&t, axis](int a, int b){ return t[a].world_min[axis] + t[a].world_max[axis] < t[b].world_min[axis] + t[b].world_max[axis]; });
+    int left = build(first, half);
+    int right = build(first + half, count - half);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+bool RayPicker::intersectTarget(const Target& target, const float* origin, const float* dir, PickHit& hit) const {
+    // into object space, the ray parameter is unaffected by the affine transform
+    float o[3], d[3];
+    matrixTransformPoint(o, target.inverse_model, origin, 1.0f);
+    matrixTransformPoint(d, target.inverse_model, dir, 0.0f);
+
+    if(!target.mesh){
+        // analytic sphere around the origin
+        float a = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+        float b = 2.0f*(o[0]*d[0] + o[1]*d[1] + o[2]*d[2]);
+        float c = o[0]*o[0] + o[1]*o[1] + o[2]*o[2] - target.radius*target.radius;
+        float disc = b*b - 4.0f*a*c;
+        if(disc < 0.0f) return false;
+        float t = (-b - sqrtf(disc))/(2.0f*a);
+        if(t < 0.0f || t >= hit.distance) return false;
+        float p[3] = {o[0] + d[0]*t, o[1] + d[1]*t, o[2] + d[2]*t};
+        // slices run around z starting at +y, stacks from the +z pole down
+        float theta = atan2f(-p[0], p[1]);
+        if(theta < 0.0f) theta += 2.0f*(float)M_PI;
+        float rho = acosf(std::max(-1.0f, std::min(1.0f, p[2]/target.radius)));
+        hit.s = theta/(2.0f*(float)M_PI);
+        hit.t = 1.0f - rho/(float)M_PI;
+        hit.distance = t;
+        return true;
+    }
+
+    bool found = false;
+    const PickMesh& mesh = *target.mesh;
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3){
+        const float* v0 = &mesh.positions[mesh.indices[i]*3];
+        const float* v1 = &mesh.positions[mesh.indices[i+1]*3];
+        const float* v2 = &mesh.positions[mesh.indices[i+2]*3];
+        // moller-trumbore, back faces are culled like in the render passes
+        float e1[3] = {v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2]};
+        float e2[3] = {v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2]};
+        float p[3] = {d[1]*e2[2] - d[2]*e2[1], d[2]*e2[0] - d[0]*e2[2], d[0]*e2[1] - d[1]*e2[0]};
+        float det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+        if(det < 1e-12f) continue;
+        float inv_det = 1.0f/det;
+        float s[3] = {o[0]-v0[0], o[1]-v0[1], o[2]-v0[2]};
+        float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inv_det;
+        if(u < 0.0f || u > 1.0f) continue;
+        float q[3] = {s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0]};
+        float v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2])*inv_det;
+        if(v < 0.0f || u + v > 1.0f) continue;
+        float t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inv_det;
+        if(t < 0.0f || t >= hit.distance) continue;
+        const float* t0 = &mesh.texcoords[mesh.indices[i]*2];
+        const float* t1 = &mesh.texcoords[mesh.indices[i+1]*2];
+        const float* t2 = &mesh.texcoords[mesh.indices[i+2]*2];
+        float w = 1.0f - u - v;
+        hit.s = w*t0[0] + u*t1[0] + v*t2[0];
+        hit.t = w*t0[1] + u*t1[1] + v*t2[1];
+        hit.distance = t;
+        found = true;
+    }
+    return found;
+}
+
+// unprojects the pixel center on the near and far plane, dir runs from one to the other
+bool RayPicker::ray(int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection, float* origin, float* dir) const {
+    float view_proj[16], inverse[16];
+    matrixMultiply(view_proj, projection, view);
+    if(!matrixInvert(inverse, view_proj)) return false;
+    float ndc_x = 2.0f*(x + 0.5f)/viewport_w - 1.0f;
+    float ndc_y = 1.0f - 2.0f*(y + 0.5f)/viewport_h;
+    float near_point[3] = {ndc_x, ndc_y, -1.0f};
+    float far_point[3] = {ndc_x, ndc_y, 1.0f};
+    float end[3];
+    matrixTransformPoint(origin, inverse, near_point, 1.0f);
+    matrixTransformPoint(end, inverse, far_point, 1.0f);
+    for(int a = 0; a < 3; a++) dir[a] = end[a] - origin[a];
+    return true;
+}
+
+PickHit RayPicker::pick(int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection) const {
+    PickHit hit;
+    hit.target = -1;
+    hit.window = NULL;
+    hit.s = hit.t = 0.0f;
+    hit.distance = 1.0f;
+    if(nodes.empty()) return hit;
+
+    float origin[3], dir[3];
+    if(!ray(x, y, viewport_w, viewport_h, view, projection, origin, dir)) return hit;
+    float inv_dir[3];
+    for(int a = 0; a < 3; a++) inv_dir[a] = dir[a] != 0.0f ? 1.0f/dir[a] : FLT_MAX;
+
+    // nearest child first so the closest hit prunes the rest
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top){
+        const Node& node = nodes[stack[--top]];
+        if(intersectBox(node.min, node.max, origin, inv_dir) >= hit.distance) continue;
+        if(node.left < 0){
+            for(int i = node.first; i < node.first + node.count; i++){
+                if(intersectTarget(targets[order[i]], origin, dir, hit)){
+                    hit.target = order[i];
+                    hit.window = targets[order[i]].window;
+                }
+            }
+            continue;
+        }
+        float dl = intersectBox(nodes[node.left].min, nodes[node.left].max, origin, inv_dir);
+        float dr = intersectBox(nodes[node.right].min, nodes[node.right].max, origin, inv_dir);
+        if(dl < dr){
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }else{
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+    return hit;
+}
+
+bool RayPicker::project(GLTextureWindow* window, int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection, float& s, float& t) const {
+    const Target* target = NULL;
+    for(size_t i = 0; i < targets.size() && !target; i++){
+        if(targets[i].window == window && targets[i].mesh && targets[i].mesh->indices.size() >= 3) target = &targets[i];
+    }
+    if(!target) return false;
+    float origin[3], dir[3];
+    if(!ray(x, y, viewport_w, viewport_h, view, projection, origin, dir)) return false;
+    float o[3], d[3];
+    matrixTransformPoint(o, target->inverse_model, origin, 1.0f);
+    matrixTransformPoint(d, target->inverse_model, dir, 0.0f);
+
+    // panels are flat and their texture coordinates affine, so the first triangle
+    // extended over its plane gives them anywhere on it
+    const PickMesh& mesh = *target->mesh;
+    const float* v0 = &mesh.positions[mesh.indices[0]*3];
+    const float* v1 = &mesh.positions[mesh.indices[1]*3];
+    const float* v2 = &mesh.positions[mesh.indices[2]*3];
+    float e1[3] = {v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2]};
+    float e2[3] = {v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2]};
+    float n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+    float denom = d[0]*n[0] + d[1]*n[1] + d[2]*n[2];
+    if(fabsf(denom) < 1e-12f) return false;
+    float along = ((v0[0]-o[0])*n[0] + (v0[1]-o[1])*n[1] + (v0[2]-o[2])*n[2])/denom;
+    if(along <= 0.0f) return false;
+    float p[3] = {o[0] + d[0]*along - v0[0], o[1] + d[1]*along - v0[1], o[2] + d[2]*along - v0[2]};
+    // barycentrics of p from the two edges, without the inside test
+    float d11 = e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2];
+    float d12 = e1[0]*e2[0] + e1[1]*e2[1] + e1[2]*e2[2];
+    float d22 = e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2];
+    float dp1 = p[0]*e1[0] + p[1]*e1[1] + p[2]*e1[2];
+    float dp2 = p[0]*e2[0] + p[1]*e2[1] + p[2]*e2[2];
+    float det = d11*d22 - d12*d12;
+    if(fabsf(det) < 1e-12f) return false;
+    float u = (d22*dp1 - d12*dp2)/det;
+    float v = (d11*dp2 - d12*dp1)/det;
+    const float* t0 = &mesh.texcoords[mesh.indices[0]*2];
+    const float* t1 = &mesh.texcoords[mesh.indices[1]*2];
+    const float* t2 = &mesh.texcoords[mesh.indices[2]*2];
+    float w = 1.0f - u - v;
+    s = w*t0[0] + u*t1[0] + v*t2[0];
+    t = w*t0[1] + u*t1[1] + v*t2[1];
+    return true;
+}
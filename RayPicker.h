@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include "Actor.h"
+#include "GLTextureWindow.h"
+
+// Triangles in object space with their texture coordinates, the CPU side copy
+// of a batch that can be picked.
+struct PickMesh {
+    std::vector<float> positions;       // xyz per vertex
+    std::vector<float> texcoords;       // st per vertex
+    std::vector<unsigned int> indices;  // 3 per triangle
+    float bounds_min[3], bounds_max[3];
+
+    void computeBounds(void);
+    static PickMesh* fromTriangleFan(const float* verts, const float* texcoords, int count);
+};
+
+struct PickHit {
+    int target;                 // index from addTarget()/addSphere(), -1 when nothing was hit
+    GLTextureWindow* window;    // window shown on the target, NULL for plain occluders
+    float s, t;                 // interpolated texture coordinates at the hit
+    float distance;             // ray parameter between the near (0) and far (1) plane
+};
+
+// Picks the window under the cursor by casting a ray through the camera into
+// the actors, no GPU work involved. Targets are kept in a bounding volume
+// hierarchy over their world bounds which is rebuilt by update() and refit
+// by refit() when actors move.
+class RayPicker {
+    public:
+        RayPicker(void);
+        ~RayPicker(void);
+
+        int addTarget(gliby::Actor* actor, const PickMesh* mesh, GLTextureWindow* window);
+        // sphere centered on the actor origin, texture coordinates follow GeometryFactory::sphere
+        int addSphere(gliby::Actor* actor, float radius, GLTextureWindow* window);
+
+        // recompute world bounds and rebuild the hierarchy, call when actors moved
+        void update(void);
+        // recompute the bounds of targets whose actor moved and refit the hierarchy to them, call before picking
+        void refit(void);
+        // x and y in window pixels with the origin top left, matrices column major
+        PickHit pick(int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection) const;
+        // texture coordinates where the ray meets the plane of a window's panel, outside
+        // 0..1 off the panel; false for spheres and when the ray runs along or away from the plane
+        bool project(GLTextureWindow* window, int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection, float& s, float& t) const;
+
+    private:
+        struct Target {
+            gliby::Actor* actor;
+            const PickMesh* mesh;
+            float radius;
+            GLTextureWindow* window;
+            float world_min[3], world_max[3];
+            float model[16];
+            float inverse_model[16];
+        };
+        struct Node {
+            float min[3], max[3];
+            int left, right;    // children, -1 for leaves
+            int first, count;   // range in order for leaves
+        };
+
+        // returns true if the actor moved since the last call
+        bool updateBounds(Target& target);
+        int build(int first, int count);
+        bool ray(int x, int y, int viewport_w, int viewport_h, const float* view, const float* projection, float* origin, float* dir) const;
+        bool intersectTarget(const Target& target, const float* origin, const float* dir, PickHit& hit) const;
+
+        std::vector<Target> targets;
+        std::vector<Node> nodes;
+        std::vector<int> order;
+};
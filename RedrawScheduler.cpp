@@ -0,0 +1,46 @@
+#include "RedrawScheduler.h"
+
+// the first frame is always drawn
+RedrawScheduler::RedrawScheduler(unsigned int settle):settle_frames(settle),frames_left(settle + 1),drawn_frames(0),idle_frames(0){
+}
+
+void RedrawScheduler::watch(GLTextureWindow* window){
+    Watched watched;
+    watched.window = window;
+    watched.version = window->paintVersion();
+    windows.push_back(watched);
+}
+
+void RedrawScheduler::invalidate(void){
+    frames_left = settle_frames + 1;
+}
+
+bool RedrawScheduler::needed(void){
+    for(size_t i = 0; i < windows.size(); i++){
+        Watched& watched = windows[i];
+        unsigned long version = watched.window->paintVersion();
+        if(version != watched.version || watched.window->pendingPaints()){
+            watched.version = version;
+            invalidate();
+        }
+    }
+    return frames_left > 0;
+}
+
+void RedrawScheduler::drawn(void){
+    if(frames_left) frames_left--;
+    drawn_frames++;
+}
+void RedrawScheduler::idled(void){
+    idle_frames++;
+}
+
+unsigned long RedrawScheduler::framesDrawn(void) const {
+    return drawn_frames;
+}
+unsigned long RedrawScheduler::framesIdled(void) const {
+    return idle_frames;
+}
+void RedrawScheduler::resetStats(void){
+    drawn_frames = idle_frames = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include "GLTextureWindow.h"
+
+// Decides whether the next frame has to be drawn at all. Watched windows mark it
+// dirty when they paint or have paints waiting, anything else that changes the
+// picture (camera, input, resize) calls invalidate(). A change keeps a few more
+// frames coming for results that arrive a frame late, like the ID pick pass, after
+// that the main loop can idle.
+class RedrawScheduler {
+    public:
+        RedrawScheduler(unsigned int settle_frames = 2);
+
+        void watch(GLTextureWindow* window);
+        void invalidate(void);
+        // whether the next frame has to be drawn, checks the watched windows
+        bool needed(void);
+        // call after every frame drawn
+        void drawn(void);
+        // call for every pass of the main loop that didn't draw
+        void idled(void);
+
+        unsigned long framesDrawn(void) const;
+        unsigned long framesIdled(void) const;
+        void resetStats(void);
+
+    private:
+        struct Watched {
+            GLTextureWindow* window;
+            unsigned long version;
+        };
+
+        std::vector<Watched> windows;
+        unsigned int settle_frames;
+        unsigned int frames_left;
+        unsigned long drawn_frames, idle_frames;
+};
@@ -0,0 +1,100 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <string.h>
+
+RenderQueue::RenderQueue(unsigned int max):max_objects(max){
+    // every object gets its own range, which has to honour the offset alignment
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stride = ((sizeof(ObjectData) + alignment - 1) / alignment) * alignment;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, stride*max_objects, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    staging.resize(stride*max_objects);
+    items.reserve(max_objects);
+}
+RenderQueue::~RenderQueue(void){
+    glDeleteBuffers(1, &buffer);
+}
+
+ProgramInfo RenderQueue::registerProgram(GLuint program){
+    ProgramInfo info;
+    info.program = program;
+    info.texture_unit = glGetUniformLocation(program, "textureUnit");
+    info.texture_array_unit = glGetUniformLocation(program, "textureArrayUnit");
+    info.tile_unit = glGetUniformLocation(program, "tileIndirectionUnit");
+    info.object_block = glGetUniformBlockIndex(program, "ObjectData");
+    // constant for the lifetime of the program, so set it here instead of per draw
+    glUseProgram(program);
+    if(info.texture_unit != -1) glUniform1i(info.texture_unit, 0);
+    if(info.texture_array_unit != -1) glUniform1i(info.texture_array_unit, ARRAY_UNIT);
+    if(info.tile_unit != -1) glUniform1i(info.tile_unit, TILE_UNIT);
+    if(info.object_block != GL_INVALID_INDEX) glUniformBlockBinding(program, info.object_block, OBJECT_BINDING);
+    glUseProgram(0);
+    return info;
+}
+
+void RenderQueue::begin(void){
+    items.clear();
+}
+
+void RenderQueue::submit(gliby::Actor* actor, const float* mvp, int index, int layer, GLuint texture, const TileBinding* tiles){
+    if(items.size() >= max_objects) return;
+    DrawItem item;
+    item.actor = actor;
+    item.texture = texture ? texture : actor->getTexture();
+    item.indirection = tiles ? tiles->indirection : 0;
+    item.array = layer >= 0 || tiles;
+    item.slot = items.size();
+    ObjectData* data = (ObjectData*)&staging[item.slot*stride];
+    memcpy(data->mvp, mvp, sizeof(data->mvp));
+    data->index = index;
+    data->layer = layer;
+    // a tile size of 0 tells the shaders the object is not tiled
+    if(tiles){
+        memcpy(data->tile_origin, tiles->origin, sizeof(data->tile_origin));
+        memcpy(data->tile_info, tiles->info, sizeof(data->tile_info));
+    }else{
+        memset(data->tile_origin, 0, sizeof(data->tile_origin));
+        memset(data->tile_info, 0, sizeof(data->tile_info));
+    }
+    items.push_back(item);
+}
+
+void RenderQueue::upload(void){
+    if(items.empty()) return;
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    // orphan last frame's data so the upload does not wait on it
+    glBufferData(GL_UNIFORM_BUFFER, stride*max_objects, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, stride*items.size(), &staging[0]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // group by texture, slots keep pointing at the right data
+    std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b){ return a.texture < b.texture; });
+}
+
+void RenderQueue::draw(const ProgramInfo& program){
+    glUseProgram(program.program);
+    GLuint bound_texture = 0;
+    for(size_t i = 0; i < items.size(); i++){
+        const DrawItem& item = items[i];
+        if(item.texture && item.texture != bound_texture){
+            if(item.array){
+                glActiveTexture(GL_TEXTURE0 + ARRAY_UNIT);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, item.texture);
+                glActiveTexture(GL_TEXTURE0);
+            }else{
+                glBindTexture(GL_TEXTURE_2D, item.texture);
+            }
+            bound_texture = item.texture;
+        }
+        // every tiled surface has its own indirection, even when sharing nothing else
+        if(item.indirection){
+            glActiveTexture(GL_TEXTURE0 + TILE_UNIT);
+            glBindTexture(GL_TEXTURE_2D, item.indirection);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, buffer, item.slot*stride, sizeof(ObjectData));
+        item.actor->getGeometry().draw();
+    }
+}
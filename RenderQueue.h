@@ -0,0 +1,66 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "Actor.h"
+#include "TiledSurface.h"
+
+// uniform locations and block index of a linked program, looked up once
+struct ProgramInfo {
+    GLuint program;
+    GLint texture_unit;     // "textureUnit" sampler, -1 when unused
+    GLint texture_array_unit; // "textureArrayUnit" sampler, -1 when unused
+    GLint tile_unit;        // "tileIndirectionUnit" sampler, -1 when unused
+    GLuint object_block;    // "ObjectData" block, GL_INVALID_INDEX when unused
+};
+
+// Collects the objects of a frame, uploads their per object uniforms into one
+// uniform buffer and draws them sorted by texture for every pass that asks.
+class RenderQueue {
+    public:
+        // binding point of the ObjectData block
+        static const GLuint OBJECT_BINDING = 0;
+        // texture unit array textures are bound to, 2D textures use unit 0
+        static const GLuint ARRAY_UNIT = 1;
+        // texture unit the indirection of a tiled surface is bound to
+        static const GLuint TILE_UNIT = 2;
+
+        RenderQueue(unsigned int max_objects = 256);
+        ~RenderQueue(void);
+
+        // reflects the program, points its samplers at their units and binds its ObjectData block
+        ProgramInfo registerProgram(GLuint program);
+
+        void begin(void);
+        // mvp is copied, index shows up as objectIndex in the shaders, a layer
+        // other than -1 means the texture is an array texture; texture replaces
+        // the actor's own when not 0, windows can change theirs; with tiles the
+        // texture is sampled through the surface's indirection instead
+        void submit(gliby::Actor* actor, const float* mvp, int index, int layer = -1, GLuint texture = 0, const TileBinding* tiles = NULL);
+        // packs the object data into the uniform buffer and sorts the draws
+        void upload(void);
+        void draw(const ProgramInfo& program);
+
+    private:
+        // std140 layout of the ObjectData block
+        struct ObjectData {
+            GLfloat mvp[16];
+            GLint index;
+            GLint layer;
+            GLint tile_origin[2];
+            GLint tile_info[4];
+        };
+        struct DrawItem {
+            gliby::Actor* actor;
+            GLuint texture;
+            GLuint indirection;
+            bool array;
+            unsigned int slot;
+        };
+
+        GLuint buffer;
+        unsigned int max_objects;
+        GLint stride;
+        std::vector<DrawItem> items;
+        std::vector<unsigned char> staging;
+};
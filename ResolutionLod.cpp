@@ -0,0 +1,57 @@
+#include "ResolutionLod.h"
+#include <algorithm>
+#include <math.h>
+
+// sizes are multiples of this, keeps rows aligned and the number of sizes small
+static const unsigned int SIZE_STEP = 32;
+
+ResolutionLod::ResolutionLod(unsigned int min, unsigned int max):
+    min_size(min),max_size(max),hysteresis(0.25f),cooldown_frames(30),next(0){
+}
+
+void ResolutionLod::add(GLTextureWindow* window){
+    Entry entry;
+    entry.window = window;
+    entry.aspect = (float)window->pageWidth()/(float)window->pageHeight();
+    entry.cooldown = 0;
+    entries.push_back(entry);
+}
+
+void ResolutionLod::update(const VisibilityScheduler& visibility){
+    bool resized = false;
+    for(size_t n = 0; n < entries.size(); n++){
+        Entry& entry = entries[(next + n) % entries.size()];
+        if(entry.cooldown){
+            entry.cooldown--;
+            continue;
+        }
+        if(resized) continue;
+        // hidden windows keep whatever they have, they don't upload anyway
+        float screen_w, screen_h;
+        visibility.projectedSize(entry.window, &screen_w, &screen_h);
+        if(screen_w <= 0.0f || screen_h <= 0.0f) continue;
+
+        // one texel per pixel along the side that needs more
+        float ideal_w = std::max(screen_w, screen_h*entry.aspect);
+        float current_w = entry.window->pageWidth();
+        if(ideal_w > current_w*(1.0f - hysteresis) && ideal_w < current_w*(1.0f + hysteresis)) continue;
+
+        float limit_w = std::min((float)max_size, max_size*entry.aspect);
+        float lower_w = std::max((float)min_size, min_size*entry.aspect);
+        ideal_w = std::min(std::max(ideal_w, lower_w), limit_w);
+        unsigned int w = (unsigned int)ceilf(ideal_w/SIZE_STEP)*SIZE_STEP;
+        unsigned int h = (unsigned int)ceilf(w/entry.aspect/SIZE_STEP)*SIZE_STEP;
+        if(w == entry.window->pageWidth() && h == entry.window->pageHeight()) continue;
+        entry.window->resize(w, h);
+        entry.cooldown = cooldown_frames;
+        next = (next + n + 1) % entries.size();
+        resized = true;
+    }
+}
+
+void ResolutionLod::setHysteresis(float fraction){
+    hysteresis = fraction;
+}
+void ResolutionLod::setCooldown(unsigned int frames){
+    cooldown_frames = frames;
+}
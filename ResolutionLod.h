@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "GLTextureWindow.h"
+#include "VisibilityScheduler.h"
+
+// Sizes windows after the screen area their actors cover, so small panels stop
+// paying for full resolution and big ones stop being blurry. A window keeps its
+// aspect ratio and is only resized once its ideal size leaves a band around the
+// current one, and at most one window is resized per update since every resize
+// makes berkelium repaint the whole page.
+class ResolutionLod {
+    public:
+        ResolutionLod(unsigned int min_size = 128, unsigned int max_size = 2048);
+
+        // the window's current size is its aspect ratio and the size it starts at
+        void add(GLTextureWindow* window);
+        // call once per frame after the visibility update
+        void update(const VisibilityScheduler& visibility);
+
+        // relative change of the ideal size that triggers a resize
+        void setHysteresis(float fraction);
+        // frames a window keeps its size after a resize
+        void setCooldown(unsigned int frames);
+
+    private:
+        struct Entry {
+            GLTextureWindow* window;
+            float aspect;
+            unsigned int cooldown;
+        };
+
+        std::vector<Entry> entries;
+        unsigned int min_size, max_size;
+        float hysteresis;
+        unsigned int cooldown_frames;
+        // round robin start, so one busy window can't starve the others
+        size_t next;
+};
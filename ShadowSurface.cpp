@@ -0,0 +1,171 @@
+#include "ShadowSurface.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int bytesPerPixel = 4;
+
+static Berkelium::Rect makeRect(int left, int top, int w, int h){
+    Berkelium::Rect r;
+    r.mLeft = left;
+    r.mTop = top;
+    r.mWidth = w;
+    r.mHeight = h;
+    return r;
+}
+
+ShadowSurface::ShadowSurface(unsigned int w, unsigned int h, unsigned int size):
+    page_width(w),page_height(h),tile_size(size),page(NULL),current_version(0){
+    allocate();
+}
+ShadowSurface::~ShadowSurface(void){
+    free(page);
+}
+
+void ShadowSurface::allocate(void){
+    free(page);
+    page = NULL;
+    size_t size = bytes();
+    if(posix_memalign((void**)&page, sysconf(_SC_PAGESIZE), size ? size : 1) != 0) page = NULL;
+    tiles_x = (page_width + tile_size - 1)/tile_size;
+    tiles_y = (page_height + tile_size - 1)/tile_size;
+    clear();
+}
+
+void ShadowSurface::clear(void){
+    if(page) memset(page, 0, bytes());
+    // everything counts as changed for copies taken before
+    current_version++;
+    tile_versions.assign(tiles_x*tiles_y, current_version);
+}
+
+void ShadowSurface::resize(unsigned int w, unsigned int h){
+    if(w == page_width && h == page_height) return;
+    page_width = w;
+    page_height = h;
+    allocate();
+}
+
+void ShadowSurface::touch(const Berkelium::Rect& rect){
+    int x0 = rect.left()/(int)tile_size, x1 = (rect.right() - 1)/(int)tile_size;
+    int y0 = rect.top()/(int)tile_size, y1 = (rect.bottom() - 1)/(int)tile_size;
+    for(int ty = y0; ty <= y1; ty++){
+        for(int tx = x0; tx <= x1; tx++) tile_versions[ty*tiles_x + tx] = current_version;
+    }
+}
+
+void ShadowSurface::write(const unsigned char* bitmap, const Berkelium::Rect& bitmap_rect, size_t num_rects, const Berkelium::Rect* rects, PixelOp op){
+    if(!page) return;
+    current_version++;
+    Berkelium::Rect bounds = makeRect(0, 0, page_width, page_height);
+    for(size_t i = 0; i < num_rects; i++){
+        Berkelium::Rect rect = rects[i].intersect(bitmap_rect).intersect(bounds);
+        int wid = rect.width();
+        int hig = rect.height();
+        if(wid <= 0 || hig <= 0) continue;
+        const unsigned char* src = bitmap + ((rect.top() - bitmap_rect.top())*bitmap_rect.width() + rect.left() - bitmap_rect.left())*bytesPerPixel;
+        unsigned char* dst = page + (rect.top()*page_width + rect.left())*bytesPerPixel;
+        convertPixelRect(op, dst, page_width*bytesPerPixel, src, bitmap_rect.width()*bytesPerPixel, wid, hig);
+        touch(rect);
+    }
+}
+
+void ShadowSurface::scroll(const Berkelium::Rect& scroll_rect, int dx, int dy){
+    if(!page || (dx == 0 && dy == 0)) return;
+    Berkelium::Rect area = scroll_rect.intersect(makeRect(0, 0, page_width, page_height));
+    Berkelium::Rect src = area.intersect(area.translate(-dx, -dy));
+    int wid = src.width();
+    int hig = src.height();
+    if(wid <= 0 || hig <= 0) return;
+    current_version++;
+    Berkelium::Rect dst = src.translate(dx, dy);
+    size_t row = page_width*bytesPerPixel;
+    unsigned char* from = page + (src.top()*page_width + src.left())*bytesPerPixel;
+    unsigned char* to = page + (dst.top()*page_width + dst.left())*bytesPerPixel;
+    // rows overlap when moving down, go bottom up then; memmove takes care of dx
+    if(dy > 0){
+        for(int jj = hig - 1; jj >= 0; jj--) memmove(to + jj*row, from + jj*row, wid*bytesPerPixel);
+    }else{
+        for(int jj = 0; jj < hig; jj++) memmove(to + jj*row, from + jj*row, wid*bytesPerPixel);
+    }
+    touch(dst);
+}
+
+const unsigned char* ShadowSurface::pixels(void) const {
+    return page;
+}
+unsigned int ShadowSurface::width(void) const {
+    return page_width;
+}
+unsigned int ShadowSurface::height(void) const {
+    return page_height;
+}
+size_t ShadowSurface::bytes(void) const {
+    return (size_t)page_width*page_height*bytesPerPixel;
+}
+unsigned long ShadowSurface::version(void) const {
+    return current_version;
+}
+
+void ShadowSurface::dirtyRects(unsigned long since, std::vector<Berkelium::Rect>& rects) const {
+    rects.clear();
+    for(unsigned int ty = 0; ty < tiles_y; ty++){
+        // runs of changed tiles in a row go out as one rect
+        unsigned int tx = 0;
+        while(tx < tiles_x){
+            if(tile_versions[ty*tiles_x + tx] <= since){
+                tx++;
+                continue;
+            }
+            unsigned int first = tx;
+            while(tx < tiles_x && tile_versions[ty*tiles_x + tx] > since) tx++;
+            int left = first*tile_size;
+            int top = ty*tile_size;
+            int right = std::min(tx*tile_size, page_width);
+            int bottom = std::min((ty + 1)*tile_size, page_height);
+            rects.push_back(makeRect(left, top, right - left, bottom - top));
+        }
+    }
+}
+
+void ShadowSurface::snapshot(ShadowSnapshot& snap) const {
+    std::vector<Berkelium::Rect> rects;
+    if(snap.width != page_width || snap.height != page_height || snap.pixels.size() != bytes()){
+        snap.width = page_width;
+        snap.height = page_height;
+        snap.pixels.resize(bytes());
+        rects.push_back(makeRect(0, 0, page_width, page_height));
+    }else{
+        dirtyRects(snap.version, rects);
+    }
+    if(page){
+        for(size_t i = 0; i < rects.size(); i++){
+            size_t offset = (rects[i].top()*page_width + rects[i].left())*bytesPerPixel;
+            for(int jj = 0; jj < rects[i].height(); jj++){
+                memcpy(&snap.pixels[offset + jj*page_width*bytesPerPixel], page + offset + jj*page_width*bytesPerPixel, rects[i].width()*bytesPerPixel);
+            }
+        }
+    }
+    snap.version = current_version;
+}
+
+void ShadowSurface::thumbnail(unsigned char* out, unsigned int w, unsigned int h) const {
+    if(!page || !w || !h) return;
+    for(unsigned int y = 0; y < h; y++){
+        unsigned int y0 = y*page_height/h, y1 = std::max((y + 1)*page_height/h, y0 + 1);
+        for(unsigned int x = 0; x < w; x++){
+            unsigned int x0 = x*page_width/w, x1 = std::max((x + 1)*page_width/w, x0 + 1);
+            unsigned int sum[4] = {0, 0, 0, 0};
+            for(unsigned int sy = y0; sy < y1 && sy < page_height; sy++){
+                const unsigned char* src = page + (sy*page_width + x0)*bytesPerPixel;
+                for(unsigned int sx = x0; sx < x1 && sx < page_width; sx++, src += bytesPerPixel){
+                    for(int c = 0; c < bytesPerPixel; c++) sum[c] += src[c];
+                }
+            }
+            unsigned int count = (std::min(y1, page_height) - y0)*(std::min(x1, page_width) - x0);
+            unsigned char* dst = out + (y*w + x)*bytesPerPixel;
+            for(int c = 0; c < bytesPerPixel; c++) dst[c] = count ? sum[c]/count : 0;
+        }
+    }
+}
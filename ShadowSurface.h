@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include "berkelium/Rect.hpp"
+#include "PixelConvert.h"
+
+// a copy of a shadow surface, kept up to date by ShadowSurface::snapshot()
+struct ShadowSnapshot {
+    ShadowSnapshot(void):width(0),height(0),version(0){}
+    unsigned int width, height;
+    std::vector<unsigned char> pixels;
+    // surface version the pixels are from, 0 for none yet
+    unsigned long version;
+};
+
+// Client memory copy of a window's page, in the layout of the page with rows of
+// width pixels. Every paint is written to it whether or not the texture can take
+// it, so the texture can be rebuilt from it at any time instead of waiting for the
+// browser to paint the whole page, and scrolls move pixels here instead of reading
+// the texture back. Each tile remembers the version it last changed at, which lets
+// snapshots and other copies only pick up the tiles that changed since they were
+// taken. The pixels start out black and are page aligned for the driver's sake.
+class ShadowSurface {
+    public:
+        ShadowSurface(unsigned int w, unsigned int h, unsigned int tile_size = 64);
+        ~ShadowSurface(void);
+
+        // contents are lost, the page paints again after a resize anyway
+        void resize(unsigned int w, unsigned int h);
+        // back to black, for a window that is going to show another page
+        void clear(void);
+        // copies rects out of a bitmap covering bitmap_rect, converting them with op
+        void write(const unsigned char* bitmap, const Berkelium::Rect& bitmap_rect, size_t num_rects, const Berkelium::Rect* rects, PixelOp op = PIXEL_COPY);
+        // berkelium's scroll: the part of scroll_rect that stays in view moves by (dx,dy)
+        void scroll(const Berkelium::Rect& scroll_rect, int dx, int dy);
+
+        const unsigned char* pixels(void) const;
+        unsigned int width(void) const;
+        unsigned int height(void) const;
+        size_t bytes(void) const;
+        // goes up with every write and scroll
+        unsigned long version(void) const;
+        // tiles changed after version since, clipped to the page
+        void dirtyRects(unsigned long since, std::vector<Berkelium::Rect>& rects) const;
+        // brings a snapshot up to date, only tiles changed since it was taken are copied
+        void snapshot(ShadowSnapshot& snap) const;
+        // box filtered copy of the page at w by h, for thumbnails
+        void thumbnail(unsigned char* out, unsigned int w, unsigned int h) const;
+
+    private:
+        void allocate(void);
+        void touch(const Berkelium::Rect& rect);
+
+        unsigned int page_width, page_height;
+        unsigned int tile_size;
+        unsigned int tiles_x, tiles_y;
+        unsigned char* page;
+        unsigned long current_version;
+        std::vector<unsigned long> tile_versions;
+};
@@ -0,0 +1,60 @@
+#include "SharedContext.h"
+#include <GL/glew.h>
+#include <GL/glxew.h>
+#include <iostream>
+
+struct SharedContext::Handles {
+    Display* display;
+    GLXContext context;
+    GLXPbuffer surface;
+};
+
+void SharedContext::initThreads(void){
+    XInitThreads();
+}
+
+SharedContext::SharedContext(void):handles(new Handles()){
+    handles->display = NULL;
+    handles->context = NULL;
+    handles->surface = 0;
+}
+SharedContext::~SharedContext(void){
+    if(handles->surface) glXDestroyPbuffer(handles->display, handles->surface);
+    if(handles->context) glXDestroyContext(handles->display, handles->context);
+    delete handles;
+}
+
+bool SharedContext::create(void){
+    Display* display = glXGetCurrentDisplay();
+    GLXContext shared = glXGetCurrentContext();
+    if(!display || !shared || !GLXEW_ARB_create_context) return false;
+    const int config_attribs[] = {GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT, GLX_RENDER_TYPE, GLX_RGBA_BIT, None};
+    int count = 0;
+    GLXFBConfig* configs = glXChooseFBConfig(display, DefaultScreen(display), config_attribs, &count);
+    if(!configs || count == 0){
+        std::cerr << "No pbuffer config for the shared context" << std::endl;
+        return false;
+    }
+    const int context_attribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 4,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+        GLX_CONTEXT_FLAGS_ARB, GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB,
+        GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+        None
+    };
+    handles->context = glXCreateContextAttribsARB(display, configs[0], shared, True, context_attribs);
+    // the context never draws, a pbuffer is only there to make it current
+    const int surface_attribs[] = {GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None};
+    if(handles->context) handles->surface = glXCreatePbuffer(display, configs[0], surface_attribs);
+    XFree(configs);
+    handles->display = display;
+    return handles->context && handles->surface;
+}
+
+bool SharedContext::makeCurrent(void){
+    return glXMakeContextCurrent(handles->display, handles->surface, handles->surface, handles->context) == True;
+}
+
+void SharedContext::release(void){
+    glXMakeContextCurrent(handles->display, None, None, NULL);
+}
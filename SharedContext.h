@@ -0,0 +1,24 @@
+#pragma once
+
+// A GLX context sharing textures and buffers with the context current on the thread
+// that creates it, bound to a 1x1 pbuffer so another thread can make it current.
+// Kept apart from the rest because Xlib's macros clash with berkelium's names.
+class SharedContext {
+    public:
+        // Xlib has to know it is used from several threads before anything else
+        // calls it, so before glfwInit()
+        static void initThreads(void);
+
+        SharedContext(void);
+        ~SharedContext(void);
+
+        // GL 4.3 core like the glfw window, false without a current GLX context
+        bool create(void);
+        // on the thread that uses the context
+        bool makeCurrent(void);
+        void release(void);
+
+    private:
+        struct Handles;
+        Handles* handles;
+};
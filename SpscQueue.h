@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Holds at most N-1 items, push() fails instead of blocking when full.
+template<class T, size_t N>
+class SpscQueue {
+    public:
+        SpscQueue(void):head(0),tail(0){}
+
+        bool push(const T& item){
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t next = (t + 1) % N;
+            if(next == head.load(std::memory_order_acquire)) return false;
+            items[t] = item;
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+        bool pop(T& item){
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire)) return false;
+            item = std::move(items[h]);
+            items[h] = T();
+            head.store((h + 1) % N, std::memory_order_release);
+            return true;
+        }
+        bool empty(void) const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        T items[N];
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+};
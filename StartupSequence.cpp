@@ -0,0 +1,51 @@
+#include "StartupSequence.h"
+
+static double secondsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to){
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()/1e6;
+}
+
+StartupSequence::StartupSequence(double seconds):next(0),budget(seconds),frames(0){
+    started = finished = std::chrono::steady_clock::now();
+}
+
+void StartupSequence::add(const std::string& name, const std::function<void()>& step){
+    Step entry;
+    entry.name = name;
+    entry.run = step;
+    entry.seconds = 0.0;
+    entry.frame = 0;
+    steps.push_back(entry);
+}
+
+bool StartupSequence::run(void){
+    if(done()) return false;
+    frames++;
+    std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+    do{
+        Step& step = steps[next++];
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        step.run();
+        finished = std::chrono::steady_clock::now();
+        step.seconds = secondsBetween(before, finished);
+        step.frame = frames;
+    }while(!done() && secondsBetween(frame_start, finished) < budget);
+    return true;
+}
+
+bool StartupSequence::done(void) const {
+    return next >= steps.size();
+}
+
+void StartupSequence::setBudget(double seconds){
+    budget = seconds;
+}
+
+double StartupSequence::elapsed(void) const {
+    return secondsBetween(started, finished);
+}
+
+void StartupSequence::report(std::ostream& out) const {
+    for(size_t i = 0; i < next; i++){
+        out << "  " << steps[i].name << ": " << steps[i].seconds*1000.0 << " ms in frame " << steps[i].frame << std::endl;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include <chrono>
+
+// Spreads the slow parts of starting up over the first frames, so the scene can be
+// shown before they are done. Steps run in the order they were added, as many per
+// frame as fit in the budget but always at least one; a step longer than the budget
+// delays the frame after it, split big work into several steps.
+class StartupSequence {
+    public:
+        // seconds of steps per frame
+        StartupSequence(double budget = 0.004);
+
+        void add(const std::string& name, const std::function<void()>& step);
+        // runs steps until the budget is spent, call once per frame; false when
+        // there was nothing left to run
+        bool run(void);
+        bool done(void) const;
+        void setBudget(double seconds);
+
+        // seconds from construction until the last step finished
+        double elapsed(void) const;
+        // how long every step that ran took and in which frame
+        void report(std::ostream& out) const;
+
+    private:
+        struct Step {
+            std::string name;
+            std::function<void()> run;
+            double seconds;
+            unsigned long frame;
+        };
+
+        std::vector<Step> steps;
+        size_t next;
+        double budget;
+        unsigned long frames;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+};
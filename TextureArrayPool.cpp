@@ -0,0 +1,41 @@
+#include "TextureArrayPool.h"
+
+TextureArrayPool::TextureArrayPool(unsigned int width, unsigned int height, unsigned int count):w(width),h(height),layers(count){
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+    GLfloat largest;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &largest);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, largest);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, w, h, layers);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    // hand out the low layers first
+    for(int i = layers - 1; i >= 0; i--) free_layers.push_back(i);
+}
+TextureArrayPool::~TextureArrayPool(void){
+    glDeleteTextures(1, &texture_id);
+}
+
+int TextureArrayPool::allocate(void){
+    if(free_layers.empty()) return -1;
+    int layer = free_layers.back();
+    free_layers.pop_back();
+    return layer;
+}
+void TextureArrayPool::release(int layer){
+    free_layers.push_back(layer);
+}
+
+GLuint TextureArrayPool::texture(void) const {
+    return texture_id;
+}
+unsigned int TextureArrayPool::width(void) const {
+    return w;
+}
+unsigned int TextureArrayPool::height(void) const {
+    return h;
+}
+size_t TextureArrayPool::bytes(void) const {
+    return (size_t)w*h*layers*4;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <stddef.h>
+
+// One GL_TEXTURE_2D_ARRAY shared by windows of the same resolution, each
+// window owns a layer. Lets all of them be drawn with a single instanced call.
+class TextureArrayPool {
+    public:
+        TextureArrayPool(unsigned int w, unsigned int h, unsigned int layers);
+        ~TextureArrayPool(void);
+
+        // returns a free layer or -1 when the pool is exhausted
+        int allocate(void);
+        void release(int layer);
+
+        GLuint texture(void) const;
+        unsigned int width(void) const;
+        unsigned int height(void) const;
+        // the storage is immutable, every layer is held whether it is in use or not
+        size_t bytes(void) const;
+
+    private:
+        GLuint texture_id;
+        unsigned int w, h, layers;
+        std::vector<int> free_layers;
+};
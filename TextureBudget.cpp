@@ -0,0 +1,86 @@
+#include "TextureBudget.h"
+#include <algorithm>
+#include <string.h>
+
+TextureBudget::TextureBudget(size_t budget):budget_bytes(budget),used_bytes(0),frame(0){
+    resetStats();
+}
+
+void TextureBudget::add(GLTextureWindow* window){
+    Entry entry;
+    entry.window = window;
+    entry.last_visible = frame;
+    entries.push_back(entry);
+}
+
+void TextureBudget::addPool(const TextureArrayPool* pool){
+    pools.push_back(pool);
+}
+
+void TextureBudget::remove(GLTextureWindow* window){
+    for(size_t i = 0; i < entries.size(); i++){
+        if(entries[i].window != window) continue;
+        window->restore();
+        entries.erase(entries.begin() + i);
+        return;
+    }
+}
+
+void TextureBudget::update(void){
+    frame++;
+    used_bytes = 0;
+    for(size_t i = 0; i < pools.size(); i++) used_bytes += pools[i]->bytes();
+    for(size_t i = 0; i < entries.size(); i++){
+        Entry& entry = entries[i];
+        if(entry.window->visible()){
+            entry.last_visible = frame;
+            if(entry.window->evicted()){
+                entry.window->restore();
+                budget_stats.restores++;
+            }
+        }
+        used_bytes += entry.window->memoryBytes();
+    }
+    if(used_bytes > budget_bytes){
+        // hidden windows, the one seen the longest ago first
+        std::vector<Entry*> candidates;
+        for(size_t i = 0; i < entries.size(); i++){
+            GLTextureWindow* window = entries[i].window;
+            // tiles keep their own working set, array layers free nothing
+            if(window->visible() || window->evicted() || window->tiledSurface() || window->layer() >= 0) continue;
+            candidates.push_back(&entries[i]);
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b){ return a->last_visible < b->last_visible; });
+        for(size_t i = 0; i < candidates.size() && used_bytes > budget_bytes; i++){
+            size_t before = candidates[i]->window->memoryBytes();
+            candidates[i]->window->evict();
+            size_t freed = before - candidates[i]->window->memoryBytes();
+            used_bytes -= freed;
+            budget_stats.evictions++;
+            budget_stats.bytes_evicted += freed;
+        }
+    }
+    budget_stats.peak_bytes = std::max(budget_stats.peak_bytes, used_bytes);
+}
+
+void TextureBudget::setBudget(size_t bytes){
+    budget_bytes = bytes;
+}
+size_t TextureBudget::budget(void) const {
+    return budget_bytes;
+}
+size_t TextureBudget::usage(void) const {
+    return used_bytes;
+}
+size_t TextureBudget::evictedWindows(void) const {
+    size_t count = 0;
+    for(size_t i = 0; i < entries.size(); i++) if(entries[i].window->evicted()) count++;
+    return count;
+}
+
+const BudgetStats& TextureBudget::stats(void) const {
+    return budget_stats;
+}
+void TextureBudget::resetStats(void){
+    memset(&budget_stats, 0, sizeof(budget_stats));
+}
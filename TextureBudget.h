@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include "GLTextureWindow.h"
+
+// budget counters, reset with TextureBudget::resetStats()
+struct BudgetStats {
+    unsigned long evictions;
+    unsigned long restores;
+    size_t bytes_evicted;
+    // highest usage seen by an update
+    size_t peak_bytes;
+};
+
+// Keeps the texture memory of the windows under a budget. Every update adds up what
+// each window and texture array holds, and while that is over the budget the hidden
+// window seen the longest ago is evicted: it drops its texture storage and buffers
+// and ignores its paints. An evicted window that becomes visible again gets its
+// storage back and asks its page for a full paint, it shows nothing until that
+// arrives. Visible windows are never evicted, and neither are windows on an array
+// layer since the array's storage is fixed; what is over budget then stays over.
+
+class TextureBudget {
+    public:
+        TextureBudget(size_t budget_bytes = 256 << 20);
+
+        void add(GLTextureWindow* window);
+        // the whole array counts once, whichever windows use its layers
+        void addPool(const TextureArrayPool* pool);
+        // restores the window if it was evicted, for windows going back to a pool
+        void remove(GLTextureWindow* window);
+        // call once per frame after the visibility update
+        void update(void);
+
+        void setBudget(size_t bytes);
+        size_t budget(void) const;
+        // bytes held by the windows after the last update
+        size_t usage(void) const;
+        size_t evictedWindows(void) const;
+
+        const BudgetStats& stats(void) const;
+        void resetStats(void);
+
+    private:
+        struct Entry {
+            GLTextureWindow* window;
+            unsigned long last_visible;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<const TextureArrayPool*> pools;
+        size_t budget_bytes;
+        size_t used_bytes;
+        unsigned long frame;
+        BudgetStats budget_stats;
+};
@@ -0,0 +1,356 @@
+#include "TiledSurface.h"
+#include <algorithm>
+#include <string.h>
+
+static const int bytesPerPixel = 4;
+
+// rounds towards negative infinity, content coordinates go negative when scrolling
+static int floorDiv(int a, int b){
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+static int wrap(int a, int b){
+    int m = a % b;
+    return m < 0 ? m + b : m;
+}
+static Berkelium::Rect makeRect(int left, int top, int w, int h){
+    Berkelium::Rect r;
+    r.mLeft = left;
+    r.mTop = top;
+    r.mWidth = w;
+    r.mHeight = h;
+    return r;
+}
+static bool rectEmpty(const Berkelium::Rect& r){
+    return r.width() <= 0 || r.height() <= 0;
+}
+
+TiledSurface::TiledSurface(unsigned int w, unsigned int h, unsigned int size, unsigned int max, GLenum fmt):
+    width(w),height(h),tile_size(size),max_tiles(max),stride(size + 2),format(fmt),read_fbo(0),
+    origin_x(0),origin_y(0),surface_visible(true),frame(0){
+
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+    // no anisotropy, its footprint would reach past the one texel border
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, stride, stride, max_tiles);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &indirection);
+    glBindTexture(GL_TEXTURE_2D, indirection);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tile_binding.atlas = atlas;
+    tile_binding.indirection = indirection;
+    tile_binding.info[2] = tile_size;
+    tile_binding.info[3] = 0;
+    resetStats();
+    resize(w, h);
+}
+TiledSurface::~TiledSurface(void){
+    glDeleteTextures(1, &atlas);
+    glDeleteTextures(1, &indirection);
+    if(read_fbo) glDeleteFramebuffers(1, &read_fbo);
+}
+
+void TiledSurface::resize(unsigned int w, unsigned int h){
+    width = w;
+    height = h;
+    visible_rect = makeRect(0, 0, w, h);
+    tile_binding.info[0] = w;
+    tile_binding.info[1] = h;
+    clear();
+}
+
+void TiledSurface::clear(void){
+    origin_x = origin_y = 0;
+    tile_binding.origin[0] = tile_binding.origin[1] = 0;
+    setupGrid();
+}
+
+// a page at any offset touches at most one tile more than it is wide
+void TiledSurface::setupGrid(void){
+    grid_w = (width + tile_size - 1)/tile_size + 1;
+    grid_h = (height + tile_size - 1)/tile_size + 1;
+    cells.assign(grid_w*grid_h, Tile());
+    for(int i = 0; i < grid_w*grid_h; i++){
+        cells[i].tx = i % grid_w;
+        cells[i].ty = i / grid_w;
+        cells[i].slot = -1;
+        cells[i].last_seen = 0;
+    }
+    cell_slots.assign(grid_w*grid_h, -1);
+    free_slots.clear();
+    for(int i = max_tiles - 1; i >= 0; i--) free_slots.push_back(i);
+    glBindTexture(GL_TEXTURE_2D, indirection);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16I, grid_w, grid_h, 0, GL_RED_INTEGER, GL_SHORT, &cell_slots[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    indirection_dirty = false;
+}
+
+void TiledSurface::setFormat(GLenum fmt){
+    format = fmt;
+}
+
+void TiledSurface::setVisibleRect(const Berkelium::Rect& rect){
+    visible_rect = rect;
+}
+
+// the cell a tile maps to, anything else still in there is stale and goes
+TiledSurface::Tile& TiledSurface::tileAt(int tx, int ty){
+    Tile& tile = cells[wrap(ty, grid_h)*grid_w + wrap(tx, grid_w)];
+    if(tile.tx != tx || tile.ty != ty){
+        releaseTile(tile);
+        tile.tx = tx;
+        tile.ty = ty;
+    }
+    return tile;
+}
+
+void TiledSurface::releaseTile(Tile& tile){
+    if(tile.slot >= 0){
+        free_slots.push_back(tile.slot);
+        tile.slot = -1;
+        cell_slots[&tile - &cells[0]] = -1;
+        indirection_dirty = true;
+    }
+    std::vector<unsigned char>().swap(tile.parked);
+}
+
+// whether a tile covers part of the page in content coordinates
+bool TiledSurface::live(int tx, int ty) const {
+    int left = tx*(int)tile_size, top = ty*(int)tile_size;
+    return left < origin_x + (int)width && left + (int)tile_size > origin_x &&
+        top < origin_y + (int)height && top + (int)tile_size > origin_y;
+}
+bool TiledSurface::seen(int tx, int ty) const {
+    if(!surface_visible || rectEmpty(visible_rect)) return false;
+    int left = tx*(int)tile_size - origin_x, top = ty*(int)tile_size - origin_y;
+    return left < visible_rect.right() && left + (int)tile_size > visible_rect.left() &&
+        top < visible_rect.bottom() && top + (int)tile_size > visible_rect.top();
+}
+
+// a free layer, or the layer of the least recently seen tile out of view, which is
+// read back and parked; -1 when every resident tile is in view
+int TiledSurface::allocateSlot(void){
+    if(!free_slots.empty()){
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        tile_stats.allocations++;
+        return slot;
+    }
+    Tile* victim = NULL;
+    for(size_t i = 0; i < cells.size(); i++){
+        Tile& tile = cells[i];
+        if(tile.slot < 0 || seen(tile.tx, tile.ty)) continue;
+        if(!victim || tile.last_seen < victim->last_seen) victim = &tile;
+    }
+    if(!victim) return -1;
+    victim->parked.resize(stride*stride*bytesPerPixel);
+    readTile(*victim, 0, 0, stride, stride, stride, &victim->parked[0]);
+    tile_stats.bytes_read_back += stride*stride*bytesPerPixel;
+    tile_stats.evictions++;
+    int slot = victim->slot;
+    victim->slot = -1;
+    cell_slots[victim - &cells[0]] = -1;
+    indirection_dirty = true;
+    tile_stats.allocations++;
+    return slot;
+}
+
+// initialises a freshly assigned layer with the parked pixels, or blank
+void TiledSurface::fillSlot(Tile& tile){
+    cell_slots[&tile - &cells[0]] = tile.slot;
+    indirection_dirty = true;
+    const unsigned char* pixels;
+    if(!tile.parked.empty()){
+        pixels = &tile.parked[0];
+        tile_stats.restores++;
+    }else{
+        if(scratch.size() < (size_t)stride*stride*bytesPerPixel) scratch.resize(stride*stride*bytesPerPixel);
+        memset(&scratch[0], 0, stride*stride*bytesPerPixel);
+        pixels = &scratch[0];
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tile.slot, stride, stride, 1, format, GL_UNSIGNED_BYTE, pixels);
+    std::vector<unsigned char>().swap(tile.parked);
+}
+
+// reads texels of a resident tile, x and y include the border
+void TiledSurface::readTile(const Tile& tile, int x, int y, int w, int h, int row_length, unsigned char* out){
+    GLint prev_read;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prev_read);
+    if(!read_fbo) glGenFramebuffers(1, &read_fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, atlas, 0, tile.slot);
+    glPixelStorei(GL_PACK_ROW_LENGTH, row_length);
+    glReadPixels(x, y, w, h, format, GL_UNSIGNED_BYTE, out);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, prev_read);
+}
+
+// piece is in content coordinates and lies within the tile's bordered area, pixels
+// points at its top left; returns the number of upload calls
+unsigned long TiledSurface::writeTile(Tile& tile, const unsigned char* pixels, int row_length, const Berkelium::Rect& piece){
+    int x = piece.left() - tile.tx*(int)tile_size + 1;
+    int y = piece.top() - tile.ty*(int)tile_size + 1;
+    if(tile.slot < 0 && seen(tile.tx, tile.ty)){
+        int slot = allocateSlot();
+        if(slot >= 0){
+            tile.slot = slot;
+            fillSlot(tile);
+        }
+    }
+    if(tile.slot >= 0){
+        tile.last_seen = frame;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, tile.slot, piece.width(), piece.height(), 1, format, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return 1;
+    }
+    // out of view or no room, keep it for when it is seen
+    if(tile.parked.empty()) tile.parked.assign(stride*stride*bytesPerPixel, 0);
+    for(int jj = 0; jj < piece.height(); jj++){
+        memcpy(&tile.parked[((y + jj)*stride + x)*bytesPerPixel], pixels + jj*row_length*bytesPerPixel, piece.width()*bytesPerPixel);
+    }
+    return 0;
+}
+
+unsigned long TiledSurface::upload(const unsigned char* pixels, int row_length, int src_x, int src_y, const std::vector<Berkelium::Rect>& rects){
+    unsigned long calls = 0;
+    Berkelium::Rect page = makeRect(origin_x, origin_y, width, height);
+    for(size_t i = 0; i < rects.size(); i++){
+        Berkelium::Rect rect = rects[i].translate(origin_x, origin_y).intersect(page);
+        if(rectEmpty(rect)) continue;
+        // every tile whose border overlaps the rect gets its part
+        int tx0 = floorDiv(rect.left() - 1, tile_size), tx1 = floorDiv(rect.right(), tile_size);
+        int ty0 = floorDiv(rect.top() - 1, tile_size), ty1 = floorDiv(rect.bottom(), tile_size);
+        for(int ty = ty0; ty <= ty1; ty++){
+            for(int tx = tx0; tx <= tx1; tx++){
+                if(!live(tx, ty)) continue;
+                Berkelium::Rect bordered = makeRect(tx*(int)tile_size - 1, ty*(int)tile_size - 1, stride, stride);
+                Berkelium::Rect piece = rect.intersect(bordered);
+                if(rectEmpty(piece)) continue;
+                const unsigned char* src = pixels + ((piece.top() - origin_y - src_y)*row_length + piece.left() - origin_x - src_x)*bytesPerPixel;
+                calls += writeTile(tileAt(tx, ty), src, row_length, piece);
+            }
+        }
+    }
+    return calls;
+}
+
+// copies a content rect out of the tiles, parts without a tile stay as they are
+void TiledSurface::readRect(const Berkelium::Rect& rect, unsigned char* out){
+    int tx0 = floorDiv(rect.left(), tile_size), tx1 = floorDiv(rect.right() - 1, tile_size);
+    int ty0 = floorDiv(rect.top(), tile_size), ty1 = floorDiv(rect.bottom() - 1, tile_size);
+    for(int ty = ty0; ty <= ty1; ty++){
+        for(int tx = tx0; tx <= tx1; tx++){
+            if(!live(tx, ty)) continue;
+            Tile& tile = tileAt(tx, ty);
+            Berkelium::Rect piece = rect.intersect(makeRect(tx*(int)tile_size, ty*(int)tile_size, tile_size, tile_size));
+            if(rectEmpty(piece)) continue;
+            int x = piece.left() - tx*(int)tile_size + 1;
+            int y = piece.top() - ty*(int)tile_size + 1;
+            unsigned char* dst = out + ((piece.top() - rect.top())*rect.width() + piece.left() - rect.left())*bytesPerPixel;
+            if(tile.slot >= 0){
+                readTile(tile, x, y, piece.width(), piece.height(), rect.width(), dst);
+                tile_stats.bytes_read_back += piece.width()*piece.height()*bytesPerPixel;
+            }else if(!tile.parked.empty()){
+                for(int jj = 0; jj < piece.height(); jj++){
+                    memcpy(dst + jj*rect.width()*bytesPerPixel, &tile.parked[((y + jj)*stride + x)*bytesPerPixel], piece.width()*bytesPerPixel);
+                }
+            }
+        }
+    }
+}
+
+void TiledSurface::releaseOffPage(void){
+    for(size_t i = 0; i < cells.size(); i++){
+        if(!live(cells[i].tx, cells[i].ty)) releaseTile(cells[i]);
+    }
+}
+
+void TiledSurface::scroll(const Berkelium::Rect& scroll_rect, int dx, int dy){
+    if(dx == 0 && dy == 0) return;
+    if(scroll_rect.left() <= 0 && scroll_rect.top() <= 0 && scroll_rect.right() >= (int)width && scroll_rect.bottom() >= (int)height){
+        // the whole page moves, so the page moves over the content instead; what
+        // scrolls in is painted by berkelium and what scrolls out is dropped
+        origin_x -= dx;
+        origin_y -= dy;
+        tile_binding.origin[0] = origin_x;
+        tile_binding.origin[1] = origin_y;
+        releaseOffPage();
+        tile_stats.remaps++;
+        return;
+    }
+    // part of the page, like a frame or a page with scrollbars: bounce the region
+    // that stays in view through client memory, only that region is read back
+    Berkelium::Rect src = scroll_rect.intersect(scroll_rect.translate(-dx, -dy));
+    if(rectEmpty(src)) return;
+    std::vector<unsigned char> moved(src.width()*src.height()*bytesPerPixel, 0);
+    readRect(src.translate(origin_x, origin_y), &moved[0]);
+    Berkelium::Rect dst = src.translate(dx, dy);
+    upload(&moved[0], src.width(), dst.left(), dst.top(), std::vector<Berkelium::Rect>(1, dst));
+}
+
+void TiledSurface::update(bool visible){
+    frame++;
+    surface_visible = visible;
+    if(visible){
+        for(size_t i = 0; i < cells.size(); i++){
+            Tile& tile = cells[i];
+            if((tile.slot < 0 && tile.parked.empty()) || !live(tile.tx, tile.ty) || !seen(tile.tx, tile.ty)) continue;
+            tile.last_seen = frame;
+            if(tile.slot >= 0) continue;
+            // parked tile came into view
+            int slot = allocateSlot();
+            if(slot < 0) continue;
+            tile.slot = slot;
+            fillSlot(tile);
+        }
+    }
+    if(indirection_dirty){
+        glBindTexture(GL_TEXTURE_2D, indirection);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, grid_w, grid_h, GL_RED_INTEGER, GL_SHORT, &cell_slots[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        indirection_dirty = false;
+    }
+}
+
+const TileBinding& TiledSurface::binding(void) const {
+    return tile_binding;
+}
+unsigned int TiledSurface::tileSize(void) const {
+    return tile_size;
+}
+size_t TiledSurface::residentTiles(void) const {
+    return max_tiles - free_slots.size();
+}
+size_t TiledSurface::parkedTiles(void) const {
+    size_t count = 0;
+    for(size_t i = 0; i < cells.size(); i++){
+        if(!cells[i].parked.empty()) count++;
+    }
+    return count;
+}
+size_t TiledSurface::residentBytes(void) const {
+    return residentTiles()*stride*stride*bytesPerPixel;
+}
+size_t TiledSurface::parkedBytes(void) const {
+    return parkedTiles()*stride*stride*bytesPerPixel;
+}
+const TileStats& TiledSurface::stats(void) const {
+    return tile_stats;
+}
+void TiledSurface::resetStats(void){
+    memset(&tile_stats, 0, sizeof(tile_stats));
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <stddef.h>
+#include "berkelium/Rect.hpp"
+
+// what a draw needs to sample a tiled surface, see simple_perspective.fp
+struct TileBinding {
+    GLuint atlas;       // GL_TEXTURE_2D_ARRAY with one resident tile per layer
+    GLuint indirection; // GL_R16I, atlas layer of every grid cell or -1
+    GLint origin[2];    // content position of the page's top left pixel
+    GLint info[4];      // page width, page height, tile size, unused
+};
+
+// tile counters, reset with TiledSurface::resetStats()
+struct TileStats {
+    unsigned long allocations;
+    unsigned long evictions;
+    unsigned long restores;
+    unsigned long remaps;
+    unsigned long bytes_read_back;
+};
+
+// Sparse backing for pages too large for a single texture. The page is cut into
+// fixed size tiles that live in the layers of an atlas array and are found through
+// a small indirection texture. A tile only gets a layer when it is painted inside
+// the visible rect; tiles painted outside it are parked in client memory, and with
+// the atlas full the least recently seen tile is read back and parked to make room.
+// Scrolls of the whole page shift the tile grid instead of moving pixels. Every tile
+// carries a one texel border copied from its neighbours so filtering hides the seams.
+class TiledSurface {
+    public:
+        TiledSurface(unsigned int w, unsigned int h, unsigned int tile_size = 256, unsigned int max_tiles = 64, GLenum format = GL_BGRA);
+        ~TiledSurface(void);
+
+        // writes rects from a pixel buffer row_length pixels wide whose first pixel sits
+        // at (origin_x,origin_y) in page coordinates, returns the number of upload calls
+        unsigned long upload(const unsigned char* pixels, int row_length, int origin_x, int origin_y, const std::vector<Berkelium::Rect>& rects);
+        // berkelium's scroll: the part of scroll_rect that stays in view moves by (dx,dy)
+        void scroll(const Berkelium::Rect& scroll_rect, int dx, int dy);
+        // page area that is seen, the whole page by default
+        void setVisibleRect(const Berkelium::Rect& rect);
+        // call once per frame: brings parked tiles that came into view back into the
+        // atlas and updates the indirection, a hidden surface only parks
+        void update(bool visible);
+        // drops every tile, for a page that will be painted from scratch
+        void clear(void);
+        void resize(unsigned int w, unsigned int h);
+        // GL_BGRA or GL_RGBA, the layout of the pixels passed to upload()
+        void setFormat(GLenum format);
+
+        const TileBinding& binding(void) const;
+        unsigned int tileSize(void) const;
+        size_t residentTiles(void) const;
+        size_t parkedTiles(void) const;
+        // atlas bytes in use and the client memory of the parked tiles
+        size_t residentBytes(void) const;
+        size_t parkedBytes(void) const;
+        const TileStats& stats(void) const;
+        void resetStats(void);
+
+    private:
+        struct Tile {
+            int tx, ty;
+            int slot;
+            std::vector<unsigned char> parked;
+            unsigned long last_seen;
+        };
+
+        Tile& tileAt(int tx, int ty);
+        void releaseTile(Tile& tile);
+        bool live(int tx, int ty) const;
+        bool seen(int tx, int ty) const;
+        int allocateSlot(void);
+        void fillSlot(Tile& tile);
+        void readTile(const Tile& tile, int x, int y, int w, int h, int row_length, unsigned char* out);
+        unsigned long writeTile(Tile& tile, const unsigned char* pixels, int row_length, const Berkelium::Rect& piece);
+        void readRect(const Berkelium::Rect& rect, unsigned char* out);
+        void releaseOffPage(void);
+        void setupGrid(void);
+
+        unsigned int width, height;
+        unsigned int tile_size;
+        unsigned int max_tiles;
+        // bordered tile size, in texels
+        int stride;
+        GLenum format;
+        GLuint atlas;
+        GLuint indirection;
+        GLuint read_fbo;
+        // cells of the grid wrap around, which lets a scrolled page keep its tiles
+        int grid_w, grid_h;
+        std::vector<Tile> cells;
+        std::vector<GLshort> cell_slots;
+        bool indirection_dirty;
+        std::vector<int> free_slots;
+        int origin_x, origin_y;
+        Berkelium::Rect visible_rect;
+        bool surface_visible;
+        unsigned long frame;
+        TileBinding tile_binding;
+        TileStats tile_stats;
+        std::vector<unsigned char> scratch;
+};
@@ -0,0 +1,141 @@
+#include "UploadWorker.h"
+#include <iostream>
+
+UploadWorker::UploadWorker(const std::function<bool()>& make, const std::function<void()>& release):
+    make_current(make),release_current(release),active(false),started(0),stall_count(0){
+}
+UploadWorker::~UploadWorker(void){
+    stop();
+    for(size_t i = 0; i < all_jobs.size(); i++) delete all_jobs[i];
+}
+
+bool UploadWorker::start(void){
+    if(active) return true;
+    active = true;
+    started = 0;
+    thread = std::thread(&UploadWorker::run, this);
+    bool ok;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [this](){ return started != 0; });
+        ok = started > 0;
+    }
+    if(!ok){
+        thread.join();
+        active = false;
+        return false;
+    }
+    return true;
+}
+
+void UploadWorker::stop(void){
+    if(!active) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active = false;
+    }
+    submitted.notify_one();
+    thread.join();
+}
+
+bool UploadWorker::running(void) const {
+    return active;
+}
+
+UploadJob* UploadWorker::acquire(void){
+    if(free_jobs.empty()){
+        UploadJob* job = new UploadJob();
+        all_jobs.push_back(job);
+        return job;
+    }
+    UploadJob* job = free_jobs.back();
+    free_jobs.pop_back();
+    return job;
+}
+
+void UploadWorker::submit(UploadJob* job){
+    job->done = 0;
+    job->issued = false;
+    job->ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // the other context only sees the fence once it is flushed
+    glFlush();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // queue full means the worker is far behind, wait for it
+        progress.wait(lock, [this, job](){ return pending.push(job); });
+    }
+    submitted.notify_one();
+}
+
+void UploadWorker::finish(UploadJob* job){
+    // the fence only exists once the worker issued the uploads
+    if(!job->issued){
+        stall_count++;
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [job](){ return (bool)job->issued; });
+    }
+    // waits on the GPU, the GL thread goes on queueing commands
+    glWaitSync(job->done, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(job->done);
+    job->done = 0;
+    job->source = NULL;
+    job->pixels.clear();
+    free_jobs.push_back(job);
+}
+
+unsigned long UploadWorker::stalls(void) const {
+    return stall_count;
+}
+
+void UploadWorker::run(void){
+    bool current = make_current();
+    if(!current) std::cerr << "Upload worker could not make its context current" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        started = current ? 1 : -1;
+    }
+    progress.notify_all();
+    if(!current) return;
+    UploadJob* job;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            submitted.wait(lock, [this](){ return !active || !pending.empty(); });
+            if(!active) break;
+        }
+        while(pending.pop(job)) upload(job);
+    }
+    // jobs still queued are waited on by the GL thread, issue them
+    while(pending.pop(job)) upload(job);
+    release_current();
+}
+
+void UploadWorker::upload(UploadJob* job){
+    glWaitSync(job->ready, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(job->ready);
+    job->ready = 0;
+    glBindTexture(job->target, job->texture);
+    const unsigned char* pixels = job->pixels.empty() ? NULL : &job->pixels[0];
+    if(job->source) glPixelStorei(GL_UNPACK_ROW_LENGTH, job->row_length);
+    for(size_t i = 0; i < job->rects.size(); i++){
+        const Berkelium::Rect& dst = job->rects[i];
+        const unsigned char* src = pixels;
+        if(job->source) src = job->source + (dst.top()*job->row_length + dst.left())*4;
+        if(job->layer >= 0){
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, dst.left(), dst.top(), job->layer, dst.width(), dst.height(), 1, job->format, GL_UNSIGNED_BYTE, src);
+        }else{
+            glTexSubImage2D(GL_TEXTURE_2D, 0, dst.left(), dst.top(), dst.width(), dst.height(), job->format, GL_UNSIGNED_BYTE, src);
+        }
+        if(!job->source) pixels += dst.width()*dst.height()*4;
+    }
+    if(job->source) glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(job->target, 0);
+    job->done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // flushed so the GL thread's wait on it can't wait forever
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job->issued = true;
+    }
+    progress.notify_all();
+}
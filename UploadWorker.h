@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "berkelium/Rect.hpp"
+#include "SpscQueue.h"
+
+// texture uploads handed to the worker. The rects are either read in place from
+// source, a page sized buffer with rows of row_length pixels that has to stay
+// untouched until the job is finished, or packed back to back in pixels
+struct UploadJob {
+    GLuint texture;
+    GLenum target;
+    int layer;          // layer of an array texture, -1 for GL_TEXTURE_2D
+    GLenum format;
+    const unsigned char* source;
+    int row_length;
+    std::vector<unsigned char> pixels;
+    std::vector<Berkelium::Rect> rects;
+    GLsync ready;       // GL thread work on the texture the upload has to follow
+    GLsync done;        // the upload calls, valid once issued is set
+    std::atomic<bool> issued;
+};
+
+// Issues texture uploads on a thread of its own, from a second context that
+// shares objects with the GL thread's. Jobs are fenced both ways: the worker waits
+// on a fence set by the GL thread when the job was submitted and fences its own
+// upload calls, which the GL thread waits on before it samples the texture.
+// Jobs are only acquired, submitted and recycled from the GL thread.
+class UploadWorker {
+    public:
+        // make_current runs on the worker thread and binds the shared context,
+        // release_current unbinds it before the thread ends
+        UploadWorker(const std::function<bool()>& make_current, const std::function<void()>& release_current);
+        ~UploadWorker(void);
+
+        // false when the context could not be made current on the worker thread
+        bool start(void);
+        void stop(void);
+        bool running(void) const;
+
+        UploadJob* acquire(void);
+        // fences what the GL thread did so far and queues the job
+        void submit(UploadJob* job);
+        // makes the GL thread's commands wait on the GPU for the job's uploads and takes
+        // it back, blocks only while the worker has not issued it yet; call it as late
+        // as possible, right before the texture is sampled or its source is written
+        void finish(UploadJob* job);
+
+        // number of times finish() found a job not yet issued
+        unsigned long stalls(void) const;
+
+    private:
+        void run(void);
+        void upload(UploadJob* job);
+
+        std::function<bool()> make_current;
+        std::function<void()> release_current;
+        std::thread thread;
+        std::atomic<bool> active;
+        int started;
+        SpscQueue<UploadJob*, 256> pending;
+        // wakes the worker on a submit, and the GL thread on a start or an issued job
+        std::mutex mutex;
+        std::condition_variable submitted;
+        std::condition_variable progress;
+        std::vector<UploadJob*> free_jobs;
+        std::vector<UploadJob*> all_jobs;
+        unsigned long stall_count;
+};
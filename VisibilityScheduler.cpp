@@ -0,0 +1,185 @@
+#include "VisibilityScheduler.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "MatrixUtil.h"
+
+// cells per side of the grid sampled to find the part of a flat actor that is in view
+static const int VIEW_GRID = 8;
+
+VisibilityScheduler::VisibilityScheduler(float area):min_area(area){
+}
+
+void VisibilityScheduler::add(gliby::Actor* actor, GLTextureWindow* window, const float* bounds_min, const float* bounds_max, const float* normal){
+    Entry entry;
+    entry.actor = actor;
+    entry.window = window;
+    for(int i = 0; i < 3; i++){
+        entry.bounds_min[i] = bounds_min[i];
+        entry.bounds_max[i] = bounds_max[i];
+        entry.normal[i] = normal[i];
+    }
+    entry.visible = true;
+    entry.area = 0.0f;
+    entry.screen_w = entry.screen_h = 0.0f;
+    entry.extent_w = entry.extent_h = 0.0f;
+    entry.page_min[0] = entry.page_min[1] = 0.0f;
+    entry.page_max[0] = entry.page_max[1] = 1.0f;
+    entries.push_back(entry);
+}
+
+void VisibilityScheduler::update(const float* view, const float* projection, int viewport_w, int viewport_h){
+    float view_proj[16], inverse_view[16];
+    matrixMultiply(view_proj, projection, view);
+    matrixInvert(inverse_view, view);
+    // camera position is the translation of the inverse view
+    float eye[3] = {inverse_view[12], inverse_view[13], inverse_view[14]};
+
+    for(size_t e = 0; e < entries.size(); e++){
+        Entry& entry = entries[e];
+        Math3D::Matrix44f model;
+        entry.actor->getFrame().getMatrix(model);
+        float mvp[16];
+        matrixMultiply(mvp, view_proj, model);
+
+        // frustum: culled when all corners are outside the same clip plane
+        int outside[6] = {0, 0, 0, 0, 0, 0};
+        float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+        bool behind = false;
+        for(int c = 0; c < 8; c++){
+            float corner[3] = {(c & 1) ? entry.bounds_max[0] : entry.bounds_min[0],
+                (c & 2) ? entry.bounds_max[1] : entry.bounds_min[1],
+                (c & 4) ? entry.bounds_max[2] : entry.bounds_min[2]};
+            float clip[4];
+            matrixTransformClip(clip, mvp, corner);
+            for(int a = 0; a < 3; a++){
+                if(clip[a] < -clip[3]) outside[a*2]++;
+                if(clip[a] > clip[3]) outside[a*2+1]++;
+            }
+            if(clip[3] <= 0.0f){
+                behind = true;
+                continue;
+            }
+            float sx = (clip[0]/clip[3]*0.5f + 0.5f)*viewport_w;
+            float sy = (clip[1]/clip[3]*0.5f + 0.5f)*viewport_h;
+            min_x = std::min(min_x, sx); max_x = std::max(max_x, sx);
+            min_y = std::min(min_y, sy); max_y = std::max(max_y, sy);
+        }
+        bool in_frustum = true;
+        for(int p = 0; p < 6; p++){
+            if(outside[p] == 8) in_frustum = false;
+        }
+
+        // facing: the camera is on the side the normal points to
+        bool facing = true;
+        if(entry.normal[0] != 0.0f || entry.normal[1] != 0.0f || entry.normal[2] != 0.0f){
+            float center_local[3];
+            for(int a = 0; a < 3; a++) center_local[a] = (entry.bounds_min[a] + entry.bounds_max[a])*0.5f;
+            float center[3], normal[3];
+            matrixTransformPoint(center, model, center_local, 1.0f);
+            matrixTransformPoint(normal, model, entry.normal, 0.0f);
+            float to_eye = (eye[0]-center[0])*normal[0] + (eye[1]-center[1])*normal[1] + (eye[2]-center[2])*normal[2];
+            facing = to_eye > 0.0f;
+        }
+
+        // screen bounds, clamped to the viewport; crossing the eye plane counts as full screen
+        if(behind){
+            min_x = min_y = 0.0f;
+            max_x = viewport_w;
+            max_y = viewport_h;
+        }
+        entry.extent_w = (in_frustum && facing) ? max_x - min_x : 0.0f;
+        entry.extent_h = (in_frustum && facing) ? max_y - min_y : 0.0f;
+        entry.screen_w = std::max(0.0f, std::min(max_x, (float)viewport_w) - std::max(min_x, 0.0f));
+        entry.screen_h = std::max(0.0f, std::min(max_y, (float)viewport_h) - std::max(min_y, 0.0f));
+        entry.area = (in_frustum && facing) ? entry.screen_w*entry.screen_h : 0.0f;
+        entry.visible = in_frustum && facing && entry.area >= min_area;
+        if(entry.visible) pageInView(entry, mvp);
+    }
+
+    // a window is visible when any of its actors is
+    for(size_t e = 0; e < entries.size(); e++){
+        bool visible = false;
+        for(size_t o = 0; o < entries.size(); o++){
+            if(entries[o].window == entries[e].window && entries[o].visible) visible = true;
+        }
+        entries[e].window->setVisible(visible);
+    }
+
+    // and the union of the page parts its actors show
+    for(size_t e = 0; e < entries.size(); e++){
+        GLTextureWindow* window = entries[e].window;
+        if(!window->tiledSurface()) continue;
+        float page_min[2] = {1.0f, 1.0f}, page_max[2] = {0.0f, 0.0f};
+        for(size_t o = 0; o < entries.size(); o++){
+            if(entries[o].window != window || !entries[o].visible) continue;
+            for(int a = 0; a < 2; a++){
+                page_min[a] = std::min(page_min[a], entries[o].page_min[a]);
+                page_max[a] = std::max(page_max[a], entries[o].page_max[a]);
+            }
+        }
+        Berkelium::Rect rect;
+        rect.mLeft = (int)floorf(page_min[0]*window->pageWidth());
+        rect.mTop = (int)floorf(page_min[1]*window->pageHeight());
+        rect.mWidth = std::max(0, (int)ceilf(page_max[0]*window->pageWidth()) - rect.mLeft);
+        rect.mHeight = std::max(0, (int)ceilf(page_max[1]*window->pageHeight()) - rect.mTop);
+        window->setVisibleRect(rect);
+    }
+}
+
+// flat actors (no depth in object space) are taken to map their bounds onto the page
+// like the panel quads, s along x and t down y; samples a grid over the face and keeps
+// the cells around the samples inside the frustum; anything else shows the whole page
+void VisibilityScheduler::pageInView(Entry& entry, const float* mvp){
+    entry.page_min[0] = entry.page_min[1] = 0.0f;
+    entry.page_max[0] = entry.page_max[1] = 1.0f;
+    if(entry.bounds_min[2] != entry.bounds_max[2]) return;
+    float page_min[2] = {1.0f, 1.0f}, page_max[2] = {0.0f, 0.0f};
+    bool any = false;
+    for(int j = 0; j <= VIEW_GRID; j++){
+        for(int i = 0; i <= VIEW_GRID; i++){
+            float s = (float)i/VIEW_GRID, t = (float)j/VIEW_GRID;
+            float point[3] = {entry.bounds_min[0] + s*(entry.bounds_max[0] - entry.bounds_min[0]),
+                entry.bounds_max[1] - t*(entry.bounds_max[1] - entry.bounds_min[1]), entry.bounds_min[2]};
+            float clip[4];
+            matrixTransformClip(clip, mvp, point);
+            if(clip[3] <= 0.0f || fabsf(clip[0]) > clip[3] || fabsf(clip[1]) > clip[3] || fabsf(clip[2]) > clip[3]) continue;
+            // a sample in view means the cells on each side of it can be too
+            page_min[0] = std::min(page_min[0], s - 1.0f/VIEW_GRID);
+            page_min[1] = std::min(page_min[1], t - 1.0f/VIEW_GRID);
+            page_max[0] = std::max(page_max[0], s + 1.0f/VIEW_GRID);
+            page_max[1] = std::max(page_max[1], t + 1.0f/VIEW_GRID);
+            any = true;
+        }
+    }
+    // zoomed in between the samples, keep the whole page
+    if(!any) return;
+    for(int a = 0; a < 2; a++){
+        entry.page_min[a] = std::max(0.0f, page_min[a]);
+        entry.page_max[a] = std::min(1.0f, page_max[a]);
+    }
+}
+
+float VisibilityScheduler::projectedArea(const GLTextureWindow* window) const {
+    float area = 0.0f;
+    for(size_t e = 0; e < entries.size(); e++){
+        if(entries[e].window == window) area += entries[e].area;
+    }
+    return area;
+}
+
+void VisibilityScheduler::projectedSize(const GLTextureWindow* window, float* w, float* h) const {
+    *w = *h = 0.0f;
+    float largest = -1.0f;
+    for(size_t e = 0; e < entries.size(); e++){
+        if(entries[e].window == window && entries[e].area > largest){
+            largest = entries[e].area;
+            *w = entries[e].extent_w;
+            *h = entries[e].extent_h;
+        }
+    }
+}
+
+void VisibilityScheduler::setMinArea(float pixels){
+    min_area = pixels;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include "Actor.h"
+#include "GLTextureWindow.h"
+
+// Decides every frame which windows are actually seen: an actor counts when its
+// bounds intersect the view frustum, it faces the camera and it covers enough
+// pixels on screen. Windows none of whose actors count are hidden, which makes
+// them defer their uploads until they show up again. Tiled windows are also told
+// which part of their page is on screen.
+class VisibilityScheduler {
+    public:
+        VisibilityScheduler(float min_area = 16.0f);
+
+        // bounds in object space, normal is the facing direction in object space
+        // or all zeros for actors that can be seen from any side
+        void add(gliby::Actor* actor, GLTextureWindow* window, const float* bounds_min, const float* bounds_max, const float* normal);
+        // matrices column major, viewport in pixels
+        void update(const float* view, const float* projection, int viewport_w, int viewport_h);
+
+        // screen area in pixels covered by a window's actors during the last update
+        float projectedArea(const GLTextureWindow* window) const;
+        // projected width and height of the largest actor showing the window, not clipped
+        // to the viewport so a panel the camera moved into still reports its full size
+        void projectedSize(const GLTextureWindow* window, float* w, float* h) const;
+        void setMinArea(float pixels);
+
+    private:
+        struct Entry {
+            gliby::Actor* actor;
+            GLTextureWindow* window;
+            float bounds_min[3], bounds_max[3];
+            float normal[3];
+            bool visible;
+            float area;
+            float screen_w, screen_h;
+            float extent_w, extent_h;
+            // part of the page in view, in texture coordinates
+            float page_min[2], page_max[2];
+        };
+
+        void pageInView(Entry& entry, const float* mvp);
+
+        std::vector<Entry> entries;
+        float min_area;
+};
@@ -1,7 +1,12 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <fstream>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
 #include <boost/filesystem.hpp>
 #include <GL/glew.h>
 #include <GL/glfw.h>
@@ -20,19 +25,81 @@
 #include "GeometryFactory.h"
 
 #include "GLTextureWindow.h"
+#include "GLTextureWindowPool.h"
+#include "RayPicker.h"
+#include "VisibilityScheduler.h"
+#include "ResolutionLod.h"
+#include "InputQueue.h"
+#include "RedrawScheduler.h"
+#include "TextureBudget.h"
+#include "UploadWorker.h"
+#include "SharedContext.h"
+#include "RenderQueue.h"
+#include "TextureArrayPool.h"
+#include "PanelInstancer.h"
+#include "FrameProfiler.h"
+#include "ProgramCache.h"
+#include "StartupSequence.h"
 
 // TODO: Sometimes the vertex buffer seems corrupt at initialisation
-// TODO: Accuracy problems (need higher resolution color buffer?)
 
 const int WINDOW_RESOLUTION = 600;
+// pump berkelium on its own thread instead of inside render()
+const bool THREADED_BERKELIUM = true;
+// record the first window's paints for paint_replay, empty to not record
+const std::string PAINT_TRACE = "";
+// how the window under the mouse is found
+enum PickMode {
+    PICK_CPU,       // ray cast against the actors
+    PICK_GPU,       // ID render pass read back through the PBO's
+    PICK_VALIDATE   // both, reporting where they disagree
+};
+const PickMode PICK_MODE = PICK_CPU;
+// back the panel windows with one texture array and draw the panels instanced
+const bool USE_TEXTURE_ARRAY = true;
+const int MAX_PANELS = 16;
+// resize windows to the screen area they cover
+const bool RESOLUTION_LOD = true;
+// back the first window with sparse tiles instead of one texture, only what is
+// painted and on screen takes up texture memory
+const bool TILED_BACKING = false;
+// keep a copy of every page in client memory, so partial paints are never dropped
+// and evicted windows come back without waiting for the browser
+const bool SHADOW_SURFACES = true;
+const int TILE_SIZE = 256;
+const int MAX_TILES = 32;
+// only draw frames when something changed, otherwise sleep this long (seconds)
+// between looking for input and paints
+const bool REDRAW_ON_DAMAGE = true;
+const double IDLE_INTERVAL = 0.005;
+// issue the texture uploads from a thread with a shared context, replaces the PBO
+// ring for the windows that are not tiled
+const bool UPLOAD_WORKER = false;
+// texture memory the windows may hold before hidden ones are evicted, in bytes
+const size_t TEXTURE_BUDGET = 64 << 20;
+// linked shader programs are kept here between runs, empty to always compile
+const std::string PROGRAM_CACHE = "./shader_cache/";
+// seconds per frame spent bringing up berkelium and the pages after the first frame
+const double STARTUP_BUDGET = 0.005;
+// phase timings are dumped this often, in seconds, to the file given with --profile
+const int PROFILE_INTERVAL = 1;
+const FrameProfiler::Format PROFILE_FORMAT = FrameProfiler::FORMAT_CSV;
 
 int mouse_x, mouse_y;
 int window_w, window_h;
 std::string current_path;
 // shader & texture stuff
 gliby::ShaderManager* shaderManager;
+ProgramCache* programCache;
 GLuint shader;
 GLuint uiTestShader;
+RenderQueue* renderQueue;
+ProgramInfo shaderInfo;
+ProgramInfo uiTestShaderInfo;
+TextureArrayPool* textureArrayPool;
+PanelInstancer* panelInstancer;
+ProgramInfo panelShaderInfo;
+ProgramInfo uiTestPanelShaderInfo;
 // transformation stuff
 gliby::Frame cameraFrame;
 gliby::Frustum viewFrustum;
@@ -44,17 +111,61 @@ GLuint uiTestBuffer;
 GLuint uiTestRenderBuffers[2];
 GLuint pixelBuffers[2];
 int pbo_index;
+// ID pass bookkeeping, the pass only runs when the answer can have changed
+bool pickPending[2];
+bool pickDirty;
+int pickMouseX, pickMouseY;
+GLTextureWindow* pickWindow;
+float pickS, pickT;
+bool pickValid;
+PixelUploadRing* uploadRing;
+SharedContext* workerContext;
+UploadWorker* uploadWorker;
+PaintTraceWriter* paintTrace;
+// frame phase timings
+FrameProfiler* profiler;
+std::ofstream profileOut;
+// print the per second counters and the startup timings, set with --verbose
+bool verbose = false;
+int phaseBerkelium, phaseVisibility, phaseUpload[2], phasePick, phaseDraw;
 // texture windows
 GLTextureWindow* texture_window;
 GLTextureWindow* second_window;
 GLTextureWindow* over_window;
-// actors
+BerkeliumThread* berkeliumThread;
+bool berkeliumStarted;
+StartupSequence startup(STARTUP_BUDGET);
+// windows are taken from here, a spare one is kept ready for the next panel
+GLTextureWindowPool* windowPool;
+// actors and the window shown on each of them
 gliby::Actor* objs[3];
-// rotate camera?
-bool rotateCamera;
+GLTextureWindow* objWindows[3];
+bool objIsPanel[3];
+// stands in for the pages that have not painted yet
+GLuint placeholderTexture;
+PickMesh* quadMesh;
+RayPicker picker;
+// hides windows whose actors are off screen, backfacing or tiny
+VisibilityScheduler visibility;
+ResolutionLod lod;
+// glfw input, handed to the windows during the pick phase
+InputQueue input;
+RedrawScheduler redraw;
+TextureBudget textureBudget(TEXTURE_BUDGET);
+// rotate camera? (set from javascript callbacks, which may run on the berkelium thread)
+std::atomic<bool> rotateCamera;
+
+// returns whether the camera was still rotating
+Berkelium::Script::Variant stopCameraRotation(const Berkelium::Script::Variant* args, size_t numArgs){
+    return Berkelium::Script::Variant(rotateCamera.exchange(false));
+}
+
+void attachWindow(int index, GLTextureWindow* window);
 
-void stopCameraRotation(){
-    rotateCamera = false; 
+// through the program cache when there is one
+GLuint buildProgram(const char* vp, const char* fp, int numAttrs, gliby::ShaderAttribute* attrs){
+    if(programCache) return programCache->buildShaderPair(vp, fp, numAttrs, attrs);
+    return shaderManager->buildShaderPair(vp, fp, numAttrs, attrs);
 }
 
 void setupContext(void){
@@ -64,7 +175,8 @@ void setupContext(void){
     glEnable(GL_DEPTH_TEST);
     // blendmode
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // berkelium paints premultiplied alpha
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     // culling
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
@@ -75,8 +187,9 @@ void setupContext(void){
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, uiTestBuffer);
     // 2 color buffers and a depth buffer
     glGenRenderbuffers(2, uiTestRenderBuffers);
+    // object index and 16 bit texture coordinates in an integer color buffer
     glBindRenderbuffer(GL_RENDERBUFFER, uiTestRenderBuffers[0]);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, window_w, window_h);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, window_w, window_h);
     glBindRenderbuffer(GL_RENDERBUFFER, uiTestRenderBuffers[1]);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, window_w, window_h);
     // attach to fbo
@@ -89,10 +202,40 @@ void setupContext(void){
     glGenBuffers(2, pixelBuffers);
     for(int i = 0; i < 2; i++){
         glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
-        glBufferData(GL_PIXEL_PACK_BUFFER, 4, NULL, GL_STREAM_READ); // TODO: why not GL_DYNAMIC_READ?
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4*sizeof(GLushort), NULL, GL_STREAM_READ); // TODO: why not GL_DYNAMIC_READ?
         glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pickPending[i] = false;
     }
     pbo_index = 0;
+    pickDirty = true;
+    pickValid = false;
+    pickWindow = NULL;
+    // profile the phases of a frame
+    profiler = new FrameProfiler();
+    phaseBerkelium = profiler->phase("berkelium update");
+    phaseVisibility = profiler->phase("visibility");
+    phaseUpload[0] = profiler->phase("upload window 0");
+    phaseUpload[1] = profiler->phase("upload window 1");
+    phasePick = profiler->phase("pick");
+    phaseDraw = profiler->phase("draw");
+    // and a ring of PBO's shared by the windows for asynchronous texture uploads, a slot
+    // holds a page at the base resolution and larger pages are split across slots
+    uploadRing = new PixelUploadRing(WINDOW_RESOLUTION*WINDOW_RESOLUTION*4, 4);
+    uploadRing->setProfiler(profiler);
+    // or a worker thread that uploads from its own context
+    workerContext = NULL;
+    uploadWorker = NULL;
+    if(UPLOAD_WORKER){
+        workerContext = new SharedContext();
+        if(workerContext->create()){
+            uploadWorker = new UploadWorker([](){ return workerContext->makeCurrent(); }, [](){ workerContext->release(); });
+            if(!uploadWorker->start()){
+                delete uploadWorker;
+                uploadWorker = NULL;
+            }
+        }
+        if(!uploadWorker) std::cout << "Could not start the upload worker, uploading from the render thread" << std::endl;
+    }
 
     // init some vars
     mouse_x = 0; mouse_y = 0;
@@ -110,9 +253,29 @@ void setupContext(void){
     searchPath->push_back("./shaders/");
     searchPath->push_back("/home/ego/projects/personal/gliby/shaders/");
     shaderManager = new gliby::ShaderManager(searchPath);
+    programCache = PROGRAM_CACHE.empty() ? NULL : new ProgramCache(PROGRAM_CACHE, searchPath);
+    std::chrono::steady_clock::time_point shadersStarted = std::chrono::steady_clock::now();
     gliby::ShaderAttribute attrs[] = {{0,"vVertex"},{3,"vTexCoord"}};
-    shader = shaderManager->buildShaderPair("simple_perspective.vp","simple_perspective.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
-    uiTestShader = shaderManager->buildShaderPair("ui_test.vp","ui_test.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
+    shader = buildProgram("simple_perspective.vp","simple_perspective.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
+    uiTestShader = buildProgram("ui_test.vp","ui_test.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
+    renderQueue = new RenderQueue();
+    shaderInfo = renderQueue->registerProgram(shader);
+    uiTestShaderInfo = renderQueue->registerProgram(uiTestShader);
+    GLuint panelShader = buildProgram("panel_instanced.vp","panel_instanced.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
+    GLuint uiTestPanelShader = buildProgram("panel_instanced.vp","ui_test_instanced.fp",sizeof(attrs)/sizeof(gliby::ShaderAttribute),attrs);
+    panelShaderInfo = renderQueue->registerProgram(panelShader);
+    uiTestPanelShaderInfo = renderQueue->registerProgram(uiTestPanelShader);
+    // cold against warm start, with --verbose
+    double shaderSeconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - shadersStarted).count()/1e6;
+    if(verbose){
+        std::cout << "Shaders built in " << shaderSeconds*1000.0 << " ms";
+        if(programCache){
+            const ProgramCacheStats& cacheStats = programCache->stats();
+            std::cout << ", program cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses (" << cacheStats.rejected << " rejected), "
+                << cacheStats.saved_seconds*1000.0 << " ms saved" << (programCache->enabled() ? "" : ", no binary formats");
+        }
+        std::cout << std::endl;
+    }
 
     // setup quad
     gliby::Batch* quad = new gliby::Batch();
@@ -141,51 +304,132 @@ void setupContext(void){
     quad->copyTexCoordData2f(texcoords,0);
     quad->copyColorData4f(colors);
     quad->end();
+    textureArrayPool = NULL;
+    panelInstancer = NULL;
+    if(USE_TEXTURE_ARRAY){
+        textureArrayPool = new TextureArrayPool(WINDOW_RESOLUTION, WINDOW_RESOLUTION, MAX_PANELS);
+        textureBudget.addPool(textureArrayPool);
+        panelInstancer = new PanelInstancer(verts, texcoords, 4, MAX_PANELS);
+    }
     // setup sphere
     gliby::TriangleBatch& sphereBatch = gliby::GeometryFactory::sphere(0.2f, 20, 20);
 
-    // initialize berkelium
-    if(!Berkelium::init(Berkelium::FileString::empty())){
-        std::cout << "Failed to initialize Berkelium!" << std::endl;
-    }
-    // create a berkelium window
+    // a grey texture stands in for every page until its first paint lands
+    const unsigned char grey[4] = {160, 160, 160, 255};
     glActiveTexture(GL_TEXTURE0);
-    texture_window = new GLTextureWindow(WINDOW_RESOLUTION,WINDOW_RESOLUTION,false,false);
-    texture_window->window()->focus(); // geeft (apparent?) input focus
-    texture_window->clear();
-    std::string url("http://thomascolliers.com");
-    texture_window->window()->navigateTo(url.data(),url.length());
-
-    // create second window
-    second_window = new GLTextureWindow(WINDOW_RESOLUTION,WINDOW_RESOLUTION,false,true);
-    second_window->window()->focus();
-    // register callback handler
-    second_window->window()->addBindOnStartLoading(Berkelium::WideString::point_to(L"stopCameraRotation"),Berkelium::Script::Variant::bindFunction(Berkelium::WideString::point_to(L"stopCameraRotation"),false));
-    CallbackHandler* handler = new CallbackHandler({Berkelium::WideString::point_to(L"stopCameraRotation"),stopCameraRotation});
-    second_window->registerCallback(handler);
-    // load local file
-    second_window->clear();
-    std::string localurl = current_path;
-    localurl.insert(0, "file://");
-    localurl.append("/example.html");
-    second_window->window()->navigateTo(localurl.data(),localurl.length());
-    over_window = NULL;
+    glGenTextures(1, &placeholderTexture);
+    glBindTexture(GL_TEXTURE_2D, placeholderTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_BGRA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
     gliby::Actor* planes[2];
-    planes[0] = new gliby::Actor(quad,texture_window->texture()); 
-    planes[1] = new gliby::Actor(quad,second_window->texture());
+    planes[0] = new gliby::Actor(quad,placeholderTexture);
+    planes[1] = new gliby::Actor(quad,placeholderTexture);
     planes[0]->getFrame().rotateWorld(degToRad(180.0f), 0.0f, 1.0f, 0.0f);
     planes[1]->getFrame().rotateWorld(degToRad(0.0f), 0.0f, 1.0f, 0.0f);
-    gliby::Actor* sphere = new gliby::Actor(&sphereBatch,texture_window->texture());
+    gliby::Actor* sphere = new gliby::Actor(&sphereBatch,placeholderTexture);
     sphere->getFrame().moveForward(0.5);
     sphere->getFrame().rotateWorld(degToRad(-90.0f), 1.0f, 0.0f, 0.0f);
     objs[0] = planes[0];
     objs[1] = planes[1];
     objs[2] = sphere;
+    objIsPanel[0] = objIsPanel[1] = true;
+    objIsPanel[2] = false;
+    quadMesh = PickMesh::fromTriangleFan(verts, texcoords, 4);
+
+    // berkelium and the pages come up over the next frames, see StartupSequence
+    berkeliumThread = NULL;
+    berkeliumStarted = false;
+    windowPool = NULL;
+    texture_window = NULL;
+    second_window = NULL;
+    over_window = NULL;
+    paintTrace = NULL;
+    for(int i = 0; i < 3; i++) objWindows[i] = NULL;
+    startup.add("berkelium", [](){
+        if(THREADED_BERKELIUM){
+            berkeliumThread = new BerkeliumThread();
+            berkeliumThread->start();
+        }else if(!Berkelium::init(Berkelium::FileString::empty())){
+            std::cout << "Failed to initialize Berkelium!" << std::endl;
+            return;
+        }
+        berkeliumStarted = true;
+        windowPool = new GLTextureWindowPool(berkeliumThread, uploadRing, textureArrayPool);
+        windowPool->setUploadWorker(uploadWorker);
+    });
+    startup.add("first window", [](){
+        if(!windowPool) return;
+        // create a berkelium window
+        texture_window = windowPool->acquire(WINDOW_RESOLUTION, WINDOW_RESOLUTION);
+        if(TILED_BACKING) texture_window->setTiled(TILE_SIZE, MAX_TILES);
+        else if(SHADOW_SURFACES) texture_window->setShadowed(true);
+        if(!PAINT_TRACE.empty()){
+            paintTrace = new PaintTraceWriter(PAINT_TRACE, WINDOW_RESOLUTION, WINDOW_RESOLUTION);
+            if(paintTrace->good()) texture_window->setTraceWriter(paintTrace);
+            else std::cerr << "Could not open paint trace " << PAINT_TRACE << std::endl;
+        }
+        texture_window->focus(); // geeft (apparent?) input focus
+        texture_window->navigateTo("http://thomascolliers.com");
+        // the sphere shows the first window too
+        attachWindow(0, texture_window);
+        attachWindow(2, texture_window);
+    });
+    startup.add("second window", [](){
+        if(!windowPool) return;
+        second_window = windowPool->acquire(WINDOW_RESOLUTION, WINDOW_RESOLUTION);
+        second_window->setVerbose(true);
+        if(SHADOW_SURFACES) second_window->setShadowed(true);
+        second_window->focus();
+        // register callback handler
+        second_window->withWindow([](Berkelium::Window* win){
+            win->addBindOnStartLoading(Berkelium::WideString::point_to(L"stopCameraRotation"),Berkelium::Script::Variant::bindFunction(Berkelium::WideString::point_to(L"stopCameraRotation"),false));
+        });
+        CallbackHandler* handler = new CallbackHandler({Berkelium::WideString::point_to(L"stopCameraRotation"),stopCameraRotation});
+        second_window->registerCallback(handler);
+        // load local file
+        std::string localurl = current_path;
+        localurl.insert(0, "file://");
+        localurl.append("/example.html");
+        second_window->navigateTo(localurl);
+        attachWindow(1, second_window);
+    });
+    // the spare window for the next panel comes last, maintain() creates it
+    startup.add("spare window", [](){
+        if(windowPool) windowPool->reserve(WINDOW_RESOLUTION, WINDOW_RESOLUTION, 1);
+    });
+}
+
+// shows a window on an actor once it exists, until then the actor has the placeholder
+void attachWindow(int index, GLTextureWindow* window){
+    objWindows[index] = window;
+    // cpu picking targets, the sphere is pickable like in the ID pass
+    // the planes face +z in object space, the sphere can be seen from anywhere
+    if(objIsPanel[index]){
+        float quadMin[3] = {-0.5f, -0.5f, 0.0f}, quadMax[3] = {0.5f, 0.5f, 0.0f}, quadNormal[3] = {0.0f, 0.0f, 1.0f};
+        picker.addTarget(objs[index], quadMesh, window);
+        visibility.add(objs[index], window, quadMin, quadMax, quadNormal);
+    }else{
+        float sphereMin[3] = {-0.2f, -0.2f, -0.2f}, sphereMax[3] = {0.2f, 0.2f, 0.2f}, noNormal[3] = {0.0f, 0.0f, 0.0f};
+        picker.addSphere(objs[index], 0.2f, window);
+        visibility.add(objs[index], window, sphereMin, sphereMax, noNormal);
+    }
+    picker.update();
+    // the rest only once per window
+    for(int i = 0; i < 3; i++){
+        if(i != index && objWindows[i] == window) return;
+    }
+    if(RESOLUTION_LOD) lod.add(window);
+    redraw.watch(window);
+    textureBudget.add(window);
 }
 
-void receiveInput(){
-    glfwGetMousePos(&mouse_x, &mouse_y);
+void mousePosCallback(int x, int y){
+    mouse_x = x;
+    mouse_y = y;
+    input.mouseMoved(x, y, glfwGetTime());
+    redraw.invalidate();
 }
 void keyCallback(int id, int state){
     if(id == GLFW_KEY_ESC && state == GLFW_RELEASE){
@@ -193,108 +437,230 @@ void keyCallback(int id, int state){
     }
 }
 void charCallback(int character, int action){
-    if(over_window){
-        //std::cout << character << " " << action << std::endl;
-        wchar_t c[2];
-        c[0] = character;
-        c[1] = 0;
-        over_window->window()->textEvent(c,1);
-    }
+    // glfw reports the release of a character too
+    if(action == GLFW_PRESS) input.character(character, glfwGetTime());
+    redraw.invalidate();
 }
 void mouseCallback(int id, int state){
-    if(id == 0 && over_window){
-        over_window->window()->mouseButton(0, state);
-    }
+    // berkelium numbers the buttons left, middle, right
+    const unsigned int buttons[] = {0, 2, 1};
+    if(id >= 0 && id < 3) input.mouseButton(buttons[id], state == GLFW_PRESS, glfwGetTime());
+    redraw.invalidate();
 }
 
-void draw(GLuint sh){
-    // ui draw pass
-    glUseProgram(sh);
+// queue the objects with their matrices, shared by every pass this frame
+void queueObjects(void){
+    renderQueue->begin();
+    if(panelInstancer) panelInstancer->begin();
     for(int i = 0; i < 3; i++){
         // setup matrix
         modelViewMatrix.pushMatrix();
         Math3D::Matrix44f mObject;
         objs[i]->getFrame().getMatrix(mObject);
         modelViewMatrix.multMatrix(mObject);
-        // load correct texture
-        if(objs[i]->getTexture()) glBindTexture(GL_TEXTURE_2D, objs[i]->getTexture());
-        // set uniforms
-        GLint locMVP = glGetUniformLocation(sh,"mvpMatrix");
-        if(locMVP != -1) glUniformMatrix4fv(locMVP, 1, GL_FALSE, transformPipeline.getModelViewProjectionMatrix());
-        GLint locTexture = glGetUniformLocation(sh,"textureUnit");
-        if(locTexture != -1) glUniform1i(locTexture, 0);
-        GLint locIndex = glGetUniformLocation(sh,"objectIndex");
-        if(locIndex != -1) glUniform1i(locIndex, i);
-        // draw
-        objs[i]->getGeometry().draw();
+        // quads showing an array layer go into the instanced draw, the rest through the queue
+        GLTextureWindow* window = objWindows[i];
+        if(!window || !window->hasContent()){
+            renderQueue->submit(objs[i], transformPipeline.getModelViewProjectionMatrix(), i, -1, placeholderTexture);
+        }else if(panelInstancer && objIsPanel[i] && objWindows[i]->layer() >= 0){
+            panelInstancer->add(transformPipeline.getModelViewProjectionMatrix(), i, objWindows[i]->layer());
+        }else{
+            TiledSurface* tiles = objWindows[i]->tiledSurface();
+            renderQueue->submit(objs[i], transformPipeline.getModelViewProjectionMatrix(), i, objWindows[i]->layer(), objWindows[i]->texture(), tiles ? &tiles->binding() : NULL);
+        }
         // clear matrix
         modelViewMatrix.popMatrix();
     }
+    renderQueue->upload();
+    if(panelInstancer) panelInstancer->upload();
+}
+
+void draw(const ProgramInfo& program, const ProgramInfo& panelProgram){
+    renderQueue->draw(program);
+    if(panelInstancer) panelInstancer->draw(panelProgram, textureArrayPool->texture());
+}
+
+// reads back an ID pass issued earlier into the cached pick result
+void readPick(int index){
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[index]);
+    GLushort* ptr = (GLushort*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+    if(ptr){
+        pickValid = true;
+        pickWindow = NULL;
+        // index is stored off by one, 0 is the cleared background
+        int over_index = (int)ptr[0] - 1;
+        if(over_index >= 0 && over_index < 3){
+            pickWindow = objWindows[over_index];
+            // retrieve texture coordinates
+            pickS = (float)ptr[1]/65535.0f;
+            pickT = (float)ptr[2]/65535.0f;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pickPending[index] = false;
+}
+
+// ID pass, only redrawn when the mouse or camera moved and only under the cursor,
+// the answer arrives a frame later
+bool gpuPick(bool cameraChanged, GLTextureWindow** window, float* s, float* t){
+    if(cameraChanged || pickDirty || mouse_x != pickMouseX || mouse_y != pickMouseY){
+        pbo_index = (pbo_index + 1) % 2;
+        int pick_y = window_h-1-mouse_y;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, uiTestBuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, uiTestBuffer);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(mouse_x, pick_y, 1, 1);
+        const GLuint background[4] = {0, 0, 0, 0};
+        glClearBufferuiv(GL_COLOR, 0, background);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        draw(uiTestShaderInfo, uiTestPanelShaderInfo);
+        glDisable(GL_SCISSOR_TEST);
+        // read pixels from framebuffer to PBO
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[pbo_index]);
+        glReadPixels(mouse_x, pick_y, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+        pickPending[pbo_index] = true;
+        pickMouseX = mouse_x;
+        pickMouseY = mouse_y;
+        pickDirty = false;
+        // the previous pass has had a frame to finish
+        int older = (pbo_index + 1) % 2;
+        if(pickPending[older]) readPick(older);
+    }else if(pickPending[pbo_index]){
+        // nothing moved, pick up the last pass
+        readPick(pbo_index);
+    }
+    // back to conventional pixel operation
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    *window = pickWindow;
+    *s = pickS;
+    *t = pickT;
+    return pickValid;
+}
+
+// the counters of the last interval for --verbose, reset for the next one
+void printCounters(void){
+    GLTextureWindow* windows[] = {texture_window, second_window};
+    for(int i = 0; i < 2; i++){
+        if(!windows[i]) continue;
+        TiledSurface* tiles = windows[i]->tiledSurface();
+        if(tiles){
+            const TileStats& tileStats = tiles->stats();
+            std::cout << "window " << i << " tiles: " << tiles->residentTiles() << " resident (" << tiles->residentBytes()/1024 << " KB), "
+                << tiles->parkedTiles() << " parked (" << tiles->parkedBytes()/1024 << " KB), " << tileStats.evictions << " evictions, "
+                << tileStats.restores << " restores, " << tileStats.remaps << " remapped scrolls" << std::endl;
+            tiles->resetStats();
+        }
+    }
+    const InputStats& inputStats = input.stats();
+    std::cout << "input: " << inputStats.moves_received << " moves, " << inputStats.moves_sent << " sent, " << inputStats.buttons << " buttons, "
+        << inputStats.characters << " characters in " << inputStats.text_events << " text events, " << inputStats.max_latency*1000.0 << " ms max latency" << std::endl;
+    input.resetStats();
+    if(uploadWorker) std::cout << "upload worker: " << uploadWorker->stalls() << " stalls" << std::endl;
+    const BudgetStats& budgetStats = textureBudget.stats();
+    std::cout << "textures: " << textureBudget.usage()/1024 << " of " << textureBudget.budget()/1024 << " KB (peak " << budgetStats.peak_bytes/1024 << " KB), "
+        << textureBudget.evictedWindows() << " windows evicted, " << budgetStats.evictions << " evictions, " << budgetStats.restores << " restores" << std::endl;
+    textureBudget.resetStats();
+    std::cout << "redraw: " << redraw.framesDrawn() << " frames drawn, " << redraw.framesIdled() << " idle waits" << std::endl;
+    redraw.resetStats();
 }
 
 void render(void){
-    // show framerate
-    static int frameCount = 0;
+    // once per interval: framerate to the page, timings to the --profile file, counters with --verbose
     static long currentSecond = 0;
-    frameCount++;
-    if((int)glfwGetTime() > currentSecond){
-        std::cout << "Framerate: " << frameCount << std::endl;
-        frameCount = 0;
+    static unsigned long lastFrames = 0;
+    if((int)glfwGetTime() >= currentSecond + PROFILE_INTERVAL){
+        if(second_window) second_window->postUpdate("framerate", (double)(profiler->frames() - lastFrames)/PROFILE_INTERVAL);
+        lastFrames = profiler->frames();
+        if(profileOut.is_open()) profiler->dump(profileOut, PROFILE_FORMAT);
+        if(verbose) printCounters();
         currentSecond = (int)glfwGetTime();
     }
 
-    // update berkelium
-    Berkelium::update();
+    // hand the values posted for the pages over before berkelium runs their scripts
+    if(texture_window) texture_window->flushUpdates();
+    if(second_window) second_window->flushUpdates();
+    // update berkelium, unless it runs on its own
+    if(!berkeliumThread && berkeliumStarted){
+        ProfileScope scope(profiler, phaseBerkelium);
+        Berkelium::update();
+    }
 
     // set up camera
-    if(rotateCamera){
+    bool cameraChanged = rotateCamera;
+    if(cameraChanged){
+        redraw.invalidate();
         cameraFrame.moveForward(3.0f);
         cameraFrame.rotateWorld(0.01f, 0.0f, 1.0f, 0.0f);
         cameraFrame.moveForward(-3.0f);
     }
     Math3D::Matrix44f mCamera;
     cameraFrame.getCameraMatrix(mCamera);
+
+    // windows nobody can see keep their paints staged until they come back into view
+    profiler->begin(phaseVisibility);
+    visibility.update(mCamera, viewFrustum.getProjectionMatrix(), window_w, window_h);
+    if(RESOLUTION_LOD) lod.update(visibility);
+    textureBudget.update();
+    profiler->end(phaseVisibility);
+    // push the paints collected during the update (or handed over by the berkelium thread) to the textures
+    profiler->begin(phaseUpload[0]);
+    if(texture_window) texture_window->flush();
+    profiler->end(phaseUpload[0]);
+    profiler->begin(phaseUpload[1]);
+    if(second_window) second_window->flush();
+    profiler->end(phaseUpload[1]);
+    if(windowPool) windowPool->maintain();
+
     modelViewMatrix.pushMatrix();
     modelViewMatrix.multMatrix(mCamera);
-
-    // draw with test ui shader
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, uiTestBuffer);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, uiTestBuffer);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    draw(uiTestShader);
-    // switch pbo index
-    pbo_index = (pbo_index + 1) % 2;
-    int next_index = (pbo_index + 1) % 2;
-    // read pixels from framebuffer to PBO
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[pbo_index]);
-    glReadPixels(mouse_x, window_h-mouse_y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    // map the pbo to process data by CPU
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[next_index]);
-    GLubyte* ptr = (GLubyte*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
-    if(ptr){
-        if((int)ptr[3] > 0){
-            int over_index = (int)ptr[0]; 
-            if(over_index == 1) over_window = second_window;
-            else over_window = texture_window;
-            // retrieve texture coordinates
-            float mousePos_x = (float)ptr[1]/256.0f;
-            float mousePos_y = (float)ptr[2]/256.0f;
-            over_window->window()->mouseMoved(mousePos_x*WINDOW_RESOLUTION,mousePos_y*WINDOW_RESOLUTION);
-        }else{
-            over_window = NULL;
-        }
-        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    queueObjects();
+
+    // find the window under the mouse and hand it this frame's input
+    profiler->begin(phasePick);
+    // actors may have moved since the hierarchy was built
+    if(PICK_MODE != PICK_GPU) picker.refit();
+    if(PICK_MODE == PICK_GPU){
+        // the ID pass only knows the window under the current position
+        InputTarget target = {NULL, 0.0f, 0.0f};
+        if(!gpuPick(cameraChanged, &target.window, &target.s, &target.t)) target.window = NULL;
+        over_window = input.deliver([&target](int x, int y){ return target; }, glfwGetTime()).window;
     }else{
-        over_window = NULL;
+        over_window = input.deliver([&mCamera](int x, int y){
+            PickHit hit = picker.pick(x, y, window_w, window_h, mCamera, viewFrustum.getProjectionMatrix());
+            InputTarget target = {hit.window, hit.s, hit.t};
+            return target;
+        }, glfwGetTime(), [&mCamera](GLTextureWindow* window, int x, int y, float& s, float& t){
+            // drags that leave their panel follow the pointer across its plane
+            return picker.project(window, x, y, window_w, window_h, mCamera, viewFrustum.getProjectionMatrix(), s, t);
+        }).window;
+        if(PICK_MODE == PICK_VALIDATE){
+            PickHit hit = picker.pick(mouse_x, mouse_y, window_w, window_h, mCamera, viewFrustum.getProjectionMatrix());
+            // the ID pass lags a frame, only report disagreement beyond a texel
+            GLTextureWindow* window;
+            float s, t;
+            float tolerance = 1.0f/WINDOW_RESOLUTION;
+            if(gpuPick(cameraChanged, &window, &s, &t) && (window != hit.window || (window && (fabsf(s - hit.s) > tolerance || fabsf(t - hit.t) > tolerance)))){
+                std::cout << "Pick mismatch at " << mouse_x << "," << mouse_y << ": cpu " << hit.window << " (" << hit.s << "," << hit.t << ") gpu "
+                    << window << " (" << (window ? s : 0.0f) << "," << (window ? t : 0.0f) << ")" << std::endl;
+            }
+        }
     }
-    // back to conventional pixel operation
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    
+    profiler->end(phasePick);
+
     // normal drawing
+    // the draw samples the textures, it follows the worker's uploads from here on; the
+    // worker had picking and queueing to issue them
+    if(texture_window) texture_window->syncUploads();
+    if(second_window) second_window->syncUploads();
+    profiler->begin(phaseDraw);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    draw(shader);
+    draw(shaderInfo, panelShaderInfo);
+    profiler->end(phaseDraw);
 
     // pop off camera transformations
     modelViewMatrix.popMatrix();
@@ -308,13 +674,15 @@ void resize(int width, int height){
     // update render buffer sizes
     if(uiTestBuffer){
         glBindRenderbuffer(GL_RENDERBUFFER, uiTestRenderBuffers[0]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA, window_w, window_h);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, window_w, window_h);
         glBindRenderbuffer(GL_RENDERBUFFER, uiTestRenderBuffers[1]);
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, window_w, window_h);
     }
     // update projection matrix
     viewFrustum.setPerspective(35.0f, float(window_w)/float(window_h),1.0f,500.0f);
     projectionMatrix.loadMatrix(viewFrustum.getProjectionMatrix());
+    pickDirty = true;
+    redraw.invalidate();
 }
 
 int main(int argc, char **argv){
@@ -325,7 +693,17 @@ int main(int argc, char **argv){
 
     current_path = boost::filesystem::system_complete(argv[0]).parent_path().parent_path().string();
 
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--profile") && i + 1 < argc) profileOut.open(argv[++i]);
+        else if(!strcmp(argv[i], "--verbose")) verbose = true;
+        else{
+            std::cerr << "usage: " << argv[0] << " [--profile timings.csv] [--verbose]" << std::endl;
+            return -1;
+        }
+    }
+
     // init glfw and window
+    if(UPLOAD_WORKER) SharedContext::initThreads();
     if(!glfwInit()){
         std::cerr << "GLFW init failed" << std::endl;
         return -1;
@@ -343,6 +721,7 @@ int main(int argc, char **argv){
     window_w = 800; window_h = 600;
     glfwSetKeyCallback(keyCallback);
     glfwSetCharCallback(charCallback);
+    glfwSetMousePosCallback(mousePosCallback);
     glfwSetMouseButtonCallback(mouseCallback);
     glfwSetWindowSizeCallback(resize);
     glfwSetWindowTitle("gltest");
@@ -359,13 +738,54 @@ int main(int argc, char **argv){
     setupContext();
 
     // main loop
+    bool firstFrame = true;
     while(glfwGetWindowParam(GLFW_OPENED)){
-        receiveInput();
+        // keep frames coming while starting up, the steps run between them
+        if(!startup.done() || (windowPool && windowPool->needsMaintenance())) redraw.invalidate();
+        if(REDRAW_ON_DAMAGE && !redraw.needed()){
+            // nothing on screen would change, wait for input, paints or page timers
+            redraw.idled();
+            glfwSleep(IDLE_INTERVAL);
+            glfwPollEvents();
+            // not profiled, idle passes are no frames
+            if(!berkeliumThread && berkeliumStarted) Berkelium::update();
+            continue;
+        }
+        profiler->beginFrame();
         render(); 
         glfwSwapBuffers();
+        profiler->endFrame();
+        redraw.drawn();
+        if(firstFrame && verbose) std::cout << "First frame after " << glfwGetTime()*1000.0 << " ms" << std::endl;
+        firstFrame = false;
+        // not profiled either, startup steps are no part of a frame
+        if(startup.run() && startup.done() && verbose){
+            std::cout << "Started up after " << glfwGetTime()*1000.0 << " ms:" << std::endl;
+            startup.report(std::cout);
+        }
     }
 
-    Berkelium::destroy();
+    // closed before the startup got to everything
+    if(texture_window){
+        textureBudget.remove(texture_window);
+        windowPool->release(texture_window);
+    }
+    if(second_window){
+        textureBudget.remove(second_window);
+        windowPool->release(second_window);
+    }
+    delete windowPool;
+    delete uploadWorker;
+    delete workerContext;
+    delete uploadRing;
+    delete paintTrace;
+    delete profiler;
+    if(berkeliumThread){
+        berkeliumThread->stop();
+        delete berkeliumThread;
+    }else if(berkeliumStarted){
+        Berkelium::destroy();
+    }
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,38 @@
+// Receives the batched updates native code posts with GLTextureWindow::postUpdate().
+// Once per frame the window calls glexp.applyUpdates([[key, value], ...]), the
+// page listens with glexp.on(key, function(value){ ... }).
+var glexp = glexp || {};
+(function(){
+    var listeners = {};
+    // last value received for every key
+    glexp.values = {};
+
+    // callback runs for every update to key, and right away when a value is known
+    glexp.on = function(key, callback){
+        (listeners[key] = listeners[key] || []).push(callback);
+        if(glexp.values.hasOwnProperty(key)) callback(glexp.values[key]);
+    };
+    glexp.off = function(key, callback){
+        var list = listeners[key];
+        if(!list) return;
+        var index = list.indexOf(callback);
+        if(index >= 0) list.splice(index, 1);
+    };
+
+    glexp.applyUpdates = function(batch){
+        for(var i = 0; i < batch.length; i++){
+            var key = batch[i][0], value = batch[i][1];
+            glexp.values[key] = value;
+            var list = listeners[key];
+            if(!list) continue;
+            for(var j = 0; j < list.length; j++){
+                // one broken listener should not cost the rest of the batch
+                try{
+                    list[j](value);
+                }catch(e){
+                    if(window.console) console.log('glexp listener for ' + key + ' failed: ' + e);
+                }
+            }
+        }
+    };
+})();
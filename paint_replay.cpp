@@ -0,0 +1,174 @@
+// Replays a paint trace recorded by GLTextureWindow into a headless window on an
+// offscreen EGL context, no browser or display needed. Reports upload throughput
+// and the time spent per paint callback.
+//
+// usage: paint_replay <trace> [--loops n] [--immediate] [--ring] [--worker] [--tiled] [--shadow [--snapshot out.ppm]] [--swizzle|--unpremultiply]
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "GLTextureWindow.h"
+#include "HeadlessContext.h"
+#include "PixelUploadRing.h"
+#include "UploadWorker.h"
+#include "PaintTrace.h"
+
+// deferred uploads are flushed once per frame of trace time
+const uint64_t FRAME_US = 16667;
+
+// binary PPM of a snapshot, for comparing replays; pixels are BGRA unless swizzled
+bool writeSnapshot(const std::string& path, const ShadowSnapshot& snap, bool rgba){
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+    fprintf(file, "P6\n%u %u\n255\n", snap.width, snap.height);
+    std::vector<unsigned char> row(snap.width*3);
+    for(unsigned int y = 0; y < snap.height; y++){
+        const unsigned char* src = &snap.pixels[y*snap.width*4];
+        for(unsigned int x = 0; x < snap.width; x++){
+            row[x*3 + 0] = src[x*4 + (rgba ? 0 : 2)];
+            row[x*3 + 1] = src[x*4 + 1];
+            row[x*3 + 2] = src[x*4 + (rgba ? 2 : 0)];
+        }
+        fwrite(&row[0], 1, row.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char** argv){
+    std::string path;
+    int loops = 1;
+    bool deferred = true;
+    bool ring = false;
+    bool worker = false;
+    bool tiled = false;
+    bool shadow = false;
+    std::string snapshot;
+    PixelOp pixel_op = PIXEL_COPY;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--loops") && i + 1 < argc) loops = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--immediate")) deferred = false;
+        else if(!strcmp(argv[i], "--ring")) ring = true;
+        else if(!strcmp(argv[i], "--worker")) worker = true;
+        else if(!strcmp(argv[i], "--tiled")) tiled = true;
+        else if(!strcmp(argv[i], "--shadow")) shadow = true;
+        else if(!strcmp(argv[i], "--snapshot") && i + 1 < argc) snapshot = argv[++i];
+        else if(!strcmp(argv[i], "--swizzle")) pixel_op = PIXEL_SWIZZLE;
+        else if(!strcmp(argv[i], "--unpremultiply")) pixel_op = PIXEL_UNPREMULTIPLY;
+        else path = argv[i];
+    }
+    if(path.empty()){
+        std::cerr << "usage: " << argv[0] << " <trace> [--loops n] [--immediate] [--ring] [--worker] [--tiled] [--shadow [--snapshot out.ppm]] [--swizzle|--unpremultiply]" << std::endl;
+        return 1;
+    }
+
+    PaintTraceReader trace(path);
+    if(!trace.good()){
+        std::cerr << "Could not read trace " << path << std::endl;
+        return 1;
+    }
+    HeadlessContext context;
+    if(!context.create(worker)) return 1;
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+    GLTextureWindow* window = new GLTextureWindow(trace.width(), trace.height(), false, false, NULL, true);
+    PixelUploadRing* uploadRing = NULL;
+    if(ring){
+        uploadRing = new PixelUploadRing(trace.width()*trace.height()*4, 4);
+        window->setUploadRing(uploadRing);
+    }
+    UploadWorker* uploadWorker = NULL;
+    if(worker){
+        uploadWorker = new UploadWorker([&context](){
+            return context.makeWorkerCurrent();
+        }, [&context](){
+            context.releaseWorker();
+        });
+        if(!context.hasWorker() || !uploadWorker->start()){
+            std::cerr << "Could not start the upload worker" << std::endl;
+            return 1;
+        }
+        window->setUploadWorker(uploadWorker);
+    }
+    if(tiled) window->setTiled();
+    if(shadow) window->setShadowed(true);
+    if(!deferred) window->setUploadMode(GLTextureWindow::UPLOAD_IMMEDIATE);
+    window->setPixelOp(pixel_op);
+
+    // traces without pixels upload a gradient instead, the sizes are what matters
+    std::vector<unsigned char> pattern;
+    if(!trace.hasPixels()){
+        pattern.resize(trace.width()*trace.height()*4);
+        for(size_t i = 0; i < pattern.size(); i++) pattern[i] = (unsigned char)(i*7);
+    }
+
+    std::vector<float> callback_us;
+    PaintTraceEntry entry;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    for(int loop = 0; loop < loops; loop++){
+        trace.rewind();
+        uint64_t next_frame = 0;
+        while(trace.next(entry)){
+            const unsigned char* pixels = entry.pixels ? entry.pixels : &pattern[0];
+            std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+            window->onPaint(NULL, pixels, entry.bitmap_rect, entry.copy_rects.size(),
+                entry.copy_rects.empty() ? NULL : &entry.copy_rects[0], entry.dx, entry.dy, entry.scroll_rect);
+            if(entry.time_us >= next_frame){
+                // the next paint syncs the worker's uploads, they overlap with the paints in between
+                window->flush();
+                next_frame = entry.time_us + FRAME_US;
+            }
+            callback_us.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - before).count()/1000.0f);
+        }
+        window->flush();
+        window->syncUploads();
+    }
+    // count the uploads the driver still has queued
+    glFinish();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count()/1e6;
+
+    if(callback_us.empty()){
+        std::cerr << "Trace has no paints" << std::endl;
+        return 1;
+    }
+    const PaintStats& stats = window->stats();
+    std::sort(callback_us.begin(), callback_us.end());
+    float total_us = 0.0f;
+    for(size_t i = 0; i < callback_us.size(); i++) total_us += callback_us[i];
+    size_t count = callback_us.size();
+    std::cout << "Replayed " << count << " paints in " << seconds << " s (" << trace.width() << "x" << trace.height()
+        << (deferred ? ", deferred" : ", immediate") << (ring ? ", upload ring" : "") << (worker ? ", upload worker" : "") << (tiled ? ", tiled" : "")
+        << (window->shadowSurface() ? ", shadowed" : "") << ")" << std::endl;
+    std::cout << "  uploads/s: " << stats.upload_calls/seconds << std::endl;
+    std::cout << "  MB/s uploaded: " << stats.bytes_uploaded/seconds/(1 << 20) << std::endl;
+    std::cout << "  MB/s copied: " << stats.bytes_copied/seconds/(1 << 20) << std::endl;
+    std::cout << "  us/callback: mean " << total_us/count << ", p50 " << callback_us[(count - 1)*50/100]
+        << ", p99 " << callback_us[(count - 1)*99/100] << ", max " << callback_us[count - 1] << std::endl;
+    if(pixel_op != PIXEL_COPY) std::cout << "  pixel kernels: " << pixelKernelIsa() << std::endl;
+    if(uploadRing) std::cout << "  ring stalls: " << uploadRing->stalls() << std::endl;
+    if(uploadWorker) std::cout << "  worker stalls: " << uploadWorker->stalls() << std::endl;
+    if(window->tiledSurface()){
+        const TileStats& tileStats = window->tiledSurface()->stats();
+        std::cout << "  tiles: " << window->tiledSurface()->residentTiles() << " resident, " << tileStats.evictions << " evictions, "
+            << tileStats.remaps << " remapped scrolls" << std::endl;
+    }
+
+    if(!snapshot.empty()){
+        if(!window->shadowSurface()){
+            std::cerr << "--snapshot needs --shadow" << std::endl;
+        }else{
+            ShadowSnapshot snap;
+            window->shadowSurface()->snapshot(snap);
+            if(!writeSnapshot(snapshot, snap, pixel_op == PIXEL_SWIZZLE)) std::cerr << "Could not write " << snapshot << std::endl;
+        }
+    }
+
+    delete window;
+    delete uploadWorker;
+    delete uploadRing;
+    return 0;
+}
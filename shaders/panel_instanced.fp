@@ -0,0 +1,14 @@
+#version 430
+
+precision mediump float;
+
+uniform sampler2DArray textureArrayUnit;
+
+smooth in vec2 vTex;
+flat in int vLayer;
+
+out vec4 gl_FragColor;
+
+void main(void){
+    gl_FragColor = texture(textureArrayUnit, vec3(vTex, float(vLayer)));
+}
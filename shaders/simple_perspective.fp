@@ -3,11 +3,42 @@
 precision mediump float;
 
 uniform sampler2D textureUnit;
+uniform sampler2DArray textureArrayUnit;
+uniform isampler2D tileIndirectionUnit;
+
+layout(std140, binding = 0) uniform ObjectData {
+    mat4 mvpMatrix;
+    int objectIndex;
+    int textureLayer;
+    ivec2 tileOrigin;
+    ivec4 tileInfo;
+};
 
 smooth in vec2 vTex;
 
 out vec4 gl_FragColor;
 
+// tiled surfaces: page pixel to content pixel, the cell grid wraps around and
+// every tile in the atlas has a one texel border
+vec4 sampleTiles(vec2 coords){
+    float tileSize = float(tileInfo.z);
+    vec2 content = coords * vec2(tileInfo.xy) + vec2(tileOrigin);
+    vec2 tile = floor(content / tileSize);
+    ivec2 cell = ivec2(mod(tile, vec2(textureSize(tileIndirectionUnit, 0))));
+    int slot = texelFetch(tileIndirectionUnit, cell, 0).r;
+    // never painted
+    if(slot < 0) return vec4(0.0);
+    vec2 inTile = (content - tile * tileSize + 1.0) / (tileSize + 2.0);
+    return texture(textureArrayUnit, vec3(inTile, float(slot)));
+}
+
 void main(void){
-    gl_FragColor = vec4(texture(textureUnit,vTex));
+    if(tileInfo.z > 0){
+        gl_FragColor = sampleTiles(vTex);
+    // windows backed by a texture array layer
+    }else if(textureLayer >= 0){
+        gl_FragColor = texture(textureArrayUnit, vec3(vTex, float(textureLayer)));
+    }else{
+        gl_FragColor = vec4(texture(textureUnit,vTex));
+    }
 }
@@ -2,18 +2,21 @@
 
 precision mediump float;
 
-uniform int objectIndex;
+layout(std140, binding = 0) uniform ObjectData {
+    mat4 mvpMatrix;
+    int objectIndex;
+    int textureLayer;
+    ivec2 tileOrigin;
+    ivec4 tileInfo;
+};
 
 smooth in vec2 vTex;
 
-out vec4 gl_FragColor;
+out uvec4 pickValue;
 
 void main(void){
-    vec4 c = vec4(0.0,0.0,0.0,1.0);
-    // put the objectIndex in the R channel
-    c.r = float(objectIndex)/256.0;
-    // and the texture coordinates in G and B channel
-    c.g = vTex[0];
-    c.b = vTex[1];
-    gl_FragColor = c;
+    // objectIndex in R, offset by one so 0 stays the background
+    // and the texture coordinates as 16 bit fixed point in G and B
+    vec2 coords = clamp(vTex, 0.0, 1.0);
+    pickValue = uvec4(uint(objectIndex + 1), uvec2(coords * 65535.0 + 0.5), 1u);
 }
@@ -0,0 +1,14 @@
+#version 430
+
+precision mediump float;
+
+smooth in vec2 vTex;
+flat in int vObjectIndex;
+
+out uvec4 pickValue;
+
+void main(void){
+    // same encoding as ui_test.fp, the index comes from the instance data
+    vec2 coords = clamp(vTex, 0.0, 1.0);
+    pickValue = uvec4(uint(vObjectIndex + 1), uvec2(coords * 65535.0 + 0.5), 1u);
+}
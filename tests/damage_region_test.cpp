@@ -0,0 +1,74 @@
+// Adds scattered rects to a DamageRegion and checks what its upload rects cover:
+// every added pixel always, and pixels nothing added only when gaps may be filled.
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "DamageRegion.h"
+
+static const int SIZE = 256;
+
+static int failures = 0;
+
+static Berkelium::Rect rect(int left, int top, int width, int height){
+    Berkelium::Rect r;
+    r.mLeft = left;
+    r.mTop = top;
+    r.mWidth = width;
+    r.mHeight = height;
+    return r;
+}
+
+static void mark(std::vector<int>& grid, const Berkelium::Rect& r){
+    for(int y = r.top(); y < r.bottom(); y++){
+        for(int x = r.left(); x < r.right(); x++) grid[y*SIZE + x]++;
+    }
+}
+
+static void run(bool fill_gaps, unsigned int seed){
+    DamageRegion region;
+    region.setFillGaps(fill_gaps);
+    std::vector<int> added(SIZE*SIZE, 0), covered(SIZE*SIZE, 0);
+    srand(seed);
+    for(int i = 0; i < 40; i++){
+        int w = 1 + rand() % 40, h = 1 + rand() % 40;
+        Berkelium::Rect r = rect(rand() % (SIZE - w), rand() % (SIZE - h), w, h);
+        region.add(r);
+        mark(added, r);
+    }
+    // two halves of one rect always merge
+    region.add(rect(200, 0, 20, 8));
+    region.add(rect(220, 0, 20, 8));
+    mark(added, rect(200, 0, 40, 8));
+    for(size_t i = 0; i < region.rects().size(); i++) mark(covered, region.rects()[i]);
+    size_t gaps = 0;
+    for(int i = 0; i < SIZE*SIZE; i++){
+        if(added[i] && !covered[i]){
+            std::cerr << "seed " << seed << (fill_gaps ? " filling" : " exact") << ": pixel " << i%SIZE << "," << i/SIZE
+                << " was added but is not uploaded" << std::endl;
+            failures++;
+            return;
+        }
+        if(!added[i] && covered[i]) gaps++;
+    }
+    if(!fill_gaps && gaps){
+        std::cerr << "seed " << seed << ": " << gaps << " pixels nothing painted are uploaded" << std::endl;
+        failures++;
+    }
+    if(fill_gaps && region.rects().size() > 16){
+        std::cerr << "seed " << seed << ": " << region.rects().size() << " rects, more than the cap" << std::endl;
+        failures++;
+    }
+}
+
+int main(int argc, char** argv){
+    for(unsigned int seed = 1; seed <= 50; seed++){
+        run(false, seed);
+        run(true, seed);
+    }
+    if(failures){
+        std::cerr << failures << " regions failed" << std::endl;
+        return 1;
+    }
+    std::cout << "damage regions cover what was added and no more than allowed" << std::endl;
+    return 0;
+}
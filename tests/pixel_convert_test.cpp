@@ -0,0 +1,78 @@
+// Runs every vector kernel the CPU supports against the scalar reference, over
+// widths that leave every possible tail, in place and through convertPixelRect.
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "PixelConvert.h"
+
+static const PixelOp ops[] = {PIXEL_COPY, PIXEL_SWIZZLE, PIXEL_PREMULTIPLY, PIXEL_UNPREMULTIPLY};
+static const char* opNames[] = {"copy", "swizzle", "premultiply", "unpremultiply"};
+static const PixelIsa isas[] = {ISA_SCALAR, ISA_SSE2, ISA_AVX2, ISA_NEON};
+
+static int failures = 0;
+
+static void fill(std::vector<unsigned char>& pixels, unsigned int seed){
+    srand(seed);
+    for(size_t i = 0; i < pixels.size(); i++) pixels[i] = rand() & 0xFF;
+    // the edges of the alpha range are where the rounding goes wrong
+    if(pixels.size() >= 8){
+        pixels[3] = 0;
+        pixels[7] = 255;
+    }
+}
+
+static void check(const char* what, const char* isa, int op, size_t width, const std::vector<unsigned char>& expected, const std::vector<unsigned char>& got){
+    if(expected == got) return;
+    size_t i = 0;
+    while(expected[i] == got[i]) i++;
+    std::cerr << what << " " << isa << " " << opNames[op] << " width " << width << ": byte " << i
+        << " is " << (int)got[i] << ", scalar gives " << (int)expected[i] << std::endl;
+    failures++;
+}
+
+int main(int argc, char** argv){
+    // every tail length of the widest kernel (16 pixels for NEON swizzle) and then some
+    for(size_t isa = 0; isa < sizeof(isas)/sizeof(isas[0]); isa++){
+        if(!pixelIsaSupported(isas[isa])) continue;
+        std::cout << "testing " << pixelIsaName(isas[isa]) << std::endl;
+        for(int op = 0; op < 4; op++){
+            PixelKernel reference = pixelKernelScalar(ops[op]);
+            PixelKernel kernel = pixelKernel(ops[op], isas[isa]);
+            for(size_t width = 1; width <= 67; width++){
+                std::vector<unsigned char> src(width*4), expected(width*4), got(width*4);
+                fill(src, width);
+                reference(&expected[0], &src[0], width);
+                kernel(&got[0], &src[0], width);
+                check("copy", pixelIsaName(isas[isa]), op, width, expected, got);
+                // in place
+                got = src;
+                kernel(&got[0], &got[0], width);
+                check("in place", pixelIsaName(isas[isa]), op, width, expected, got);
+            }
+        }
+    }
+
+    // strided blocks take the fastest kernel row by row, contiguous ones in one go
+    for(int op = 0; op < 4; op++){
+        PixelKernel reference = pixelKernelScalar(ops[op]);
+        for(int width = 1; width <= 19; width += 3){
+            for(int pad = 0; pad <= 5; pad += 5){
+                const int height = 7;
+                size_t src_stride = (width + pad)*4, dst_stride = (width + 2*pad)*4;
+                std::vector<unsigned char> src(src_stride*height), expected(dst_stride*height, 0), got(dst_stride*height, 0);
+                fill(src, width*31 + pad);
+                for(int row = 0; row < height; row++) reference(&expected[row*dst_stride], &src[row*src_stride], width);
+                convertPixelRect(ops[op], &got[0], dst_stride, &src[0], src_stride, width, height);
+                check("rect", pixelKernelIsa(), op, width, expected, got);
+            }
+        }
+    }
+
+    if(failures){
+        std::cerr << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "all kernels match the scalar reference" << std::endl;
+    return 0;
+}
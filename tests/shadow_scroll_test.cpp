@@ -0,0 +1,95 @@
+// Scrolls a shadowed window while damage from an earlier paint is still waiting for
+// the flush, then reads the texture back and compares it with the shadow. Needs GL,
+// runs on a headless EGL context like paint_replay.
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include "GLTextureWindow.h"
+#include "HeadlessContext.h"
+
+static const unsigned int WIDTH = 96, HEIGHT = 80;
+
+static Berkelium::Rect rect(int left, int top, int width, int height){
+    Berkelium::Rect r;
+    r.mLeft = left;
+    r.mTop = top;
+    r.mWidth = width;
+    r.mHeight = height;
+    return r;
+}
+
+// every pixel different, so a row or column landing in the wrong place shows up
+static std::vector<unsigned char> page(unsigned int seed){
+    std::vector<unsigned char> pixels(WIDTH*HEIGHT*4);
+    for(unsigned int y = 0; y < HEIGHT; y++){
+        for(unsigned int x = 0; x < WIDTH; x++){
+            unsigned char* p = &pixels[(y*WIDTH + x)*4];
+            p[0] = (unsigned char)(x*3 + seed);
+            p[1] = (unsigned char)(y*5 + seed);
+            p[2] = (unsigned char)(x ^ y);
+            p[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+static int failures = 0;
+
+static void scrollWithDamagePending(GLTextureWindow::ScrollMode mode, int dx, int dy){
+    GLTextureWindow* window = new GLTextureWindow(WIDTH, HEIGHT, false, false, NULL, true);
+    window->setShadowed(true);
+    window->setScrollMode(mode);
+    Berkelium::Rect full = rect(0, 0, WIDTH, HEIGHT);
+    Berkelium::Rect none = rect(0, 0, 0, 0);
+
+    std::vector<unsigned char> first = page(0);
+    window->onPaint(NULL, &first[0], full, 1, &full, 0, 0, none);
+    window->flush();
+
+    // a partial paint that is not flushed before the scroll
+    Berkelium::Rect damaged = rect(10, 20, 40, 30);
+    std::vector<unsigned char> second = page(100);
+    window->onPaint(NULL, &second[0], full, 1, &damaged, 0, 0, none);
+
+    // the scroll exposes a strip the browser paints in the same callback
+    Berkelium::Rect exposed = dy > 0 ? rect(0, 0, WIDTH, dy) : dy < 0 ? rect(0, HEIGHT + dy, WIDTH, -dy)
+        : dx > 0 ? rect(0, 0, dx, HEIGHT) : rect(WIDTH + dx, 0, -dx, HEIGHT);
+    std::vector<unsigned char> third = page(200);
+    window->onPaint(NULL, &third[0], full, 1, &exposed, dx, dy, full);
+    window->flush();
+    window->syncUploads();
+
+    std::vector<unsigned char> texture(WIDTH*HEIGHT*4);
+    glBindTexture(GL_TEXTURE_2D, window->texture());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, &texture[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    const unsigned char* shadow = window->shadowSurface()->pixels();
+    for(size_t i = 0; i < texture.size(); i++){
+        if(texture[i] == shadow[i]) continue;
+        size_t pixel = i/4;
+        std::cerr << "scroll mode " << mode << " by " << dx << "," << dy << ": pixel " << pixel%WIDTH << "," << pixel/WIDTH
+            << " differs from the shadow" << std::endl;
+        failures++;
+        break;
+    }
+    delete window;
+}
+
+int main(int argc, char** argv){
+    HeadlessContext context;
+    if(!context.create()) return 1;
+    const GLTextureWindow::ScrollMode modes[] = {GLTextureWindow::SCROLL_COPY_IMAGE, GLTextureWindow::SCROLL_BLIT};
+    for(int mode = 0; mode < 2; mode++){
+        scrollWithDamagePending(modes[mode], 0, 7);
+        scrollWithDamagePending(modes[mode], 0, -7);
+        scrollWithDamagePending(modes[mode], 5, 0);
+        scrollWithDamagePending(modes[mode], -5, 0);
+    }
+    if(failures){
+        std::cerr << failures << " scrolls left the texture out of step with the shadow" << std::endl;
+        return 1;
+    }
+    std::cout << "scrolled textures match the shadow" << std::endl;
+    return 0;
+}